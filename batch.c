@@ -0,0 +1,792 @@
+#include "batch.h"
+#include "log.h"
+#include "chip8_exec.h"
+#include "lanes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CHIP8_PAGE_MASK (CHIP8_PAGE_SIZE - 1)
+
+#if defined(__GNUC__) && !defined(__TINYC__)
+#define batch_lock(b) while (__sync_lock_test_and_set(&(b)->pool_lock, 1))
+#define batch_unlock(b) __sync_lock_release(&(b)->pool_lock)
+#define batch_forked(b, p) __atomic_load_n(&(b)->forked[p], __ATOMIC_RELAXED)
+#define batch_set_forked(b, p) __atomic_store_n(&(b)->forked[p], 1, __ATOMIC_RELAXED)
+#define batch_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define batch_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define batch_fail(b) __atomic_store_n(&(b)->failed, true, __ATOMIC_RELAXED)
+#else
+#define batch_lock(b) ((void)0)
+#define batch_unlock(b) ((void)0)
+#define batch_forked(b, p) ((b)->forked[p])
+#define batch_set_forked(b, p) ((b)->forked[p] = 1)
+#define batch_load(p) (*(p))
+#define batch_store(p, v) (*(p) = (v))
+#define batch_fail(b) ((b)->failed = true)
+#endif
+
+/* one instance's registers pulled out of the batch while it runs. names
+ * follow chip8 so the shared interpreter runs it, the stack, screen and
+ * memory stay in the batch and are reached through the macros below */
+typedef struct {
+    bool key_waiting;
+    bool register_waiting;
+    uint32_t keys;
+    uint16_t i;
+    uint16_t pc;
+    uint8_t v[NUM_REGISTERS];
+    uint8_t delaytimer, soundtimer;
+    uint8_t sp;
+    chip8_settings settings;
+    uint64_t rng;
+    uint64_t instret;
+    uint64_t mem_hash, screen_hash;
+    uint64_t *screen;
+    size_t k;
+    chip8_batch *batch;
+    uint16_t sink; /* stack entry to use once the batch failed */
+} batch_lane;
+
+/* hand out the next item of size bytes from a chunked pool as at, under
+ * pool_lock. false if there was no memory for a new chunk */
+static bool batch_grow(uint8_t **chunks, size_t *len, size_t size, size_t *at) {
+    if (*len % CHIP8_BATCH_CHUNK == 0) {
+        /* zeroed, a new table is all image pages */
+        chunks[*len / CHIP8_BATCH_CHUNK] = calloc(CHIP8_BATCH_CHUNK, size);
+        if (chunks[*len / CHIP8_BATCH_CHUNK] == NULL)
+            return false;
+    }
+    *at = (*len)++;
+    return true;
+}
+
+static uint32_t *batch_table(const chip8_batch *b, uint32_t t) {
+    return (uint32_t *)(b->tables[t / CHIP8_BATCH_CHUNK]
+            + (size_t)(t % CHIP8_BATCH_CHUNK) * CHIP8_BATCH_TABLE * sizeof(uint32_t));
+}
+
+/* instance k's table entry for page p, NULL while it has no table there */
+static uint32_t *batch_entry(const chip8_batch *b, size_t k, uint32_t p) {
+    uint32_t t = b->dirs[k * CHIP8_BATCH_DIRS + p / CHIP8_BATCH_TABLE];
+    return t == 0 ? NULL : batch_table(b, t - 1) + p % CHIP8_BATCH_TABLE;
+}
+
+static uint8_t *batch_page(const chip8_batch *b, size_t k, uint32_t p) {
+    const uint32_t *entry = batch_entry(b, k, p);
+    if (entry == NULL || *entry == 0)
+        return b->image + ((size_t)p << CHIP8_PAGE_SHIFT);
+    uint32_t at = *entry - 1;
+    return b->pool[at / CHIP8_BATCH_CHUNK] + ((size_t)(at % CHIP8_BATCH_CHUNK) << CHIP8_PAGE_SHIFT);
+}
+
+/* give instance k a private copy of page p, NULL and the batch marked
+ * failed if there is no memory for it */
+static uint8_t *batch_own(chip8_batch *b, size_t k, uint32_t p) {
+    uint32_t *entry = batch_entry(b, k, p);
+    if (entry != NULL && *entry != 0)
+        return batch_page(b, k, p);
+    batch_lock(b);
+    size_t t, at;
+    if (entry == NULL) {
+        if (!batch_grow(b->tables, &b->tables_len, CHIP8_BATCH_TABLE * sizeof(uint32_t), &t))
+            goto fail;
+        b->dirs[k * CHIP8_BATCH_DIRS + p / CHIP8_BATCH_TABLE] = t + 1;
+        entry = batch_table(b, t) + p % CHIP8_BATCH_TABLE;
+    }
+    if (!batch_grow(b->pool, &b->pool_len, CHIP8_PAGE_SIZE, &at))
+        goto fail;
+    /* only read as a hint, an instance relies on it for its own pages */
+    batch_set_forked(b, p);
+    batch_unlock(b);
+    *entry = at + 1;
+    uint8_t *page = batch_page(b, k, p);
+    memcpy(page, b->image + ((size_t)p << CHIP8_PAGE_SHIFT), CHIP8_PAGE_SIZE);
+    return page;
+fail:
+    batch_unlock(b);
+    batch_fail(b);
+    return NULL;
+}
+
+/* stack entry d of instance k, giving depth d its row if nobody has yet.
+ * sink stands in for it and the batch is marked failed if there is no
+ * memory for the row */
+static uint16_t *batch_stack(chip8_batch *b, uint32_t d, size_t k, uint16_t *sink) {
+    uint16_t *row = batch_load(&b->stack[d]);
+    if (row == NULL) {
+        batch_lock(b);
+        row = b->stack[d];
+        if (row == NULL && (row = calloc(b->n, sizeof *row)) != NULL)
+            batch_store(&b->stack[d], row);
+        batch_unlock(b);
+        if (row == NULL) {
+            batch_fail(b);
+            return sink;
+        }
+    }
+    return row + k;
+}
+
+static uint8_t lane_read(const batch_lane *lane, uint32_t addr) {
+    if (addr >= MEMORY_SIZE)
+        return 0;
+    return batch_page(lane->batch, lane->k, addr >> CHIP8_PAGE_SHIFT)[addr & CHIP8_PAGE_MASK];
+}
+
+static void lane_write(batch_lane *lane, uint32_t addr, uint8_t val) {
+    if (addr >= MEMORY_SIZE)
+        return;
+    uint8_t old = lane_read(lane, addr);
+    /* storing what is already there must not unshare the page */
+    if (old == val)
+        return;
+    lane->mem_hash ^= chip8_mem_key(addr, old) ^ chip8_mem_key(addr, val);
+    uint8_t *page = batch_own(lane->batch, lane->k, addr >> CHIP8_PAGE_SHIFT);
+    if (page != NULL)
+        page[addr & CHIP8_PAGE_MASK] = val;
+}
+
+static bool lane_pixel(const batch_lane *lane, int x, int y) {
+    return lane->screen[y] >> (63 - x) & 1;
+}
+
+static void lane_flip(batch_lane *lane, int x, int y) {
+    lane->screen[y] ^= (uint64_t)1 << (63 - x);
+    lane->screen_hash ^= chip8_pixel_key(x, y);
+}
+
+static void lane_clear(batch_lane *lane) {
+    memset(lane->screen, 0, HEIGHT * sizeof *lane->screen);
+    lane->screen_hash = 0;
+}
+
+#define CHIP8_EXEC_TYPE batch_lane
+#define CHIP8_EXEC_NAME lane_execute
+#define CHIP8_HASH_NAME lane_hash
+#define CHIP8_READ(c, addr) lane_read(c, addr)
+#define CHIP8_WRITE(c, addr, val) lane_write(c, addr, val)
+#define CHIP8_PIXEL(c, x, y) lane_pixel(c, x, y)
+#define CHIP8_FLIP(c, x, y) lane_flip(c, x, y)
+#define CHIP8_CLEAR(c) lane_clear(c)
+/* the hash reads through a const lane, only a running one writes the sink */
+#define CHIP8_STACK(c, d) (*batch_stack((c)->batch, d, (c)->k, (uint16_t *)&(c)->sink))
+#include "chip8_exec.h"
+
+static void batch_gather(const chip8_batch *b, size_t k, batch_lane *lane) {
+    lane->key_waiting = b->key_waiting[k];
+    lane->register_waiting = b->register_waiting[k];
+    lane->keys = b->keys[k];
+    lane->i = b->i[k];
+    lane->pc = b->pc[k];
+    for (int r = 0; r < NUM_REGISTERS; r++)
+        lane->v[r] = b->v[r][k];
+    lane->delaytimer = b->delaytimer[k];
+    lane->soundtimer = b->soundtimer[k];
+    lane->sp = b->sp[k];
+    lane->settings = b->settings;
+    lane->rng = b->rng[k];
+    lane->instret = b->instret[k];
+    lane->mem_hash = b->mem_hash[k];
+    lane->screen_hash = b->screen_hash[k];
+    lane->screen = b->screen + k * HEIGHT;
+    lane->k = k;
+    lane->batch = (chip8_batch *)b;
+}
+
+static void batch_scatter(chip8_batch *b, size_t k, const batch_lane *lane) {
+    b->key_waiting[k] = lane->key_waiting;
+    b->register_waiting[k] = lane->register_waiting;
+    b->keys[k] = lane->keys;
+    b->i[k] = lane->i;
+    b->pc[k] = lane->pc;
+    for (int r = 0; r < NUM_REGISTERS; r++)
+        b->v[r][k] = lane->v[r];
+    b->delaytimer[k] = lane->delaytimer;
+    b->soundtimer[k] = lane->soundtimer;
+    b->sp[k] = lane->sp;
+    b->rng[k] = lane->rng;
+    b->instret[k] = lane->instret;
+    b->mem_hash[k] = lane->mem_hash;
+    b->screen_hash[k] = lane->screen_hash;
+}
+
+/* n copies of proto. its memory becomes the shared image */
+chip8_batch *chip8_batch_new(const chip8 *proto, size_t n) {
+    if (n == 0)
+        return NULL;
+    chip8_batch *b = calloc(1, sizeof *b);
+    if (b == NULL)
+        return NULL;
+    b->n = n;
+    b->clockspeed = proto->clockspeed < 60 ? 60 : proto->clockspeed;
+    b->settings = proto->settings;
+    b->rom_size = proto->rom_size;
+    /* without simd the bookkeeping costs more than it saves */
+    b->lockstep = LANES_SIMD;
+
+    /* whole groups, so lanes can be loaded past the last instance */
+    size_t padded = (n + CHIP8_LANES - 1) / CHIP8_LANES * CHIP8_LANES;
+    bool ok = true;
+#define BATCH_ALLOC(field, count) \
+    ok = ok && (b->field = calloc(count, sizeof *b->field)) != NULL
+    BATCH_ALLOC(pc, padded);
+    BATCH_ALLOC(i, padded);
+    for (int r = 0; r < NUM_REGISTERS; r++)
+        BATCH_ALLOC(v[r], padded);
+    BATCH_ALLOC(sp, padded);
+    BATCH_ALLOC(delaytimer, padded);
+    BATCH_ALLOC(soundtimer, padded);
+    BATCH_ALLOC(key_waiting, padded);
+    BATCH_ALLOC(register_waiting, padded);
+    BATCH_ALLOC(keys, padded);
+    BATCH_ALLOC(rng, padded);
+    BATCH_ALLOC(cycle, padded);
+    BATCH_ALLOC(instret, padded);
+    BATCH_ALLOC(mem_hash, padded);
+    BATCH_ALLOC(screen_hash, padded);
+    BATCH_ALLOC(screen, n * HEIGHT);
+    BATCH_ALLOC(dirs, n * CHIP8_BATCH_DIRS);
+    BATCH_ALLOC(image, (size_t)CHIP8_PAGES << CHIP8_PAGE_SHIFT);
+    /* room for every page of every instance to go private */
+    BATCH_ALLOC(tables, (n * CHIP8_BATCH_DIRS + CHIP8_BATCH_CHUNK - 1) / CHIP8_BATCH_CHUNK);
+    BATCH_ALLOC(pool, (n * CHIP8_PAGES + CHIP8_BATCH_CHUNK - 1) / CHIP8_BATCH_CHUNK);
+#undef BATCH_ALLOC
+    if (!ok) {
+        warn("Failed to allocate a batch of %zu chip8", n);
+        chip8_batch_free(b);
+        return NULL;
+    }
+    memcpy(b->image, proto->memory, MEMORY_SIZE);
+    for (size_t k = 0; k < n; k++) {
+        if (!chip8_batch_set(b, k, proto)) {
+            warn("Failed to allocate a batch of %zu chip8", n);
+            chip8_batch_free(b);
+            return NULL;
+        }
+    }
+    return b;
+}
+
+void chip8_batch_free(chip8_batch *b) {
+    if (b == NULL)
+        return;
+    free(b->pc);
+    free(b->i);
+    for (int r = 0; r < NUM_REGISTERS; r++)
+        free(b->v[r]);
+    free(b->sp);
+    free(b->delaytimer);
+    free(b->soundtimer);
+    free(b->key_waiting);
+    free(b->register_waiting);
+    free(b->keys);
+    free(b->rng);
+    free(b->cycle);
+    free(b->instret);
+    free(b->mem_hash);
+    free(b->screen_hash);
+    for (int d = 0; d < CHIP8_BATCH_STACK; d++)
+        free(b->stack[d]);
+    free(b->screen);
+    free(b->dirs);
+    free(b->image);
+    if (b->tables != NULL)
+        for (size_t c = 0; c * CHIP8_BATCH_CHUNK < b->tables_len; c++)
+            free(b->tables[c]);
+    free(b->tables);
+    if (b->pool != NULL)
+        for (size_t c = 0; c * CHIP8_BATCH_CHUNK < b->pool_len; c++)
+            free(b->pool[c]);
+    free(b->pool);
+    free(b);
+}
+
+/* put src into instance k, only the pages where it differs from the
+ * image are copied. clock and quirks stay the batch's. false if the batch
+ * ran out of memory, see chip8_batch_step */
+bool chip8_batch_set(chip8_batch *b, size_t k, const chip8 *src) {
+    batch_lane lane;
+    batch_gather(b, k, &lane);
+    lane.key_waiting = src->key_waiting;
+    lane.register_waiting = src->register_waiting;
+    lane.keys = src->keys;
+    lane.i = src->i;
+    lane.pc = src->pc;
+    memcpy(lane.v, src->v, sizeof lane.v);
+    lane.delaytimer = src->delaytimer;
+    lane.soundtimer = src->soundtimer;
+    lane.sp = src->sp;
+    lane.rng = src->rng;
+    lane.instret = src->instret;
+    lane.mem_hash = src->mem_hash;
+    lane.screen_hash = src->screen_hash;
+    batch_scatter(b, k, &lane);
+    b->cycle[k] = src->cycle;
+
+    /* only depths something was ever pushed to have rows */
+    uint16_t sink;
+    for (int d = 0; d < CHIP8_BATCH_STACK; d++)
+        if (src->stack[d] != 0 || batch_load(&b->stack[d]) != NULL)
+            *batch_stack(b, d, k, &sink) = src->stack[d];
+    for (int y = 0; y < HEIGHT; y++) {
+        uint64_t row = 0;
+        for (int x = 0; x < WIDTH; x++)
+            row |= (uint64_t)(src->screen[y][x] != 0) << (63 - x);
+        lane.screen[y] = row;
+    }
+    for (uint32_t p = 0; p < CHIP8_PAGES; p++) {
+        size_t at = (size_t)p << CHIP8_PAGE_SHIFT;
+        size_t len = at + CHIP8_PAGE_SIZE > MEMORY_SIZE ? MEMORY_SIZE - at : CHIP8_PAGE_SIZE;
+        const uint32_t *entry = batch_entry(b, k, p);
+        if ((entry == NULL || *entry == 0) && memcmp(b->image + at, src->memory + at, len) == 0)
+            continue;
+        uint8_t *page = batch_own(b, k, p);
+        if (page == NULL)
+            return false;
+        memcpy(page, src->memory + at, len);
+    }
+    return !b->failed;
+}
+
+/* same streams as chip8_seed */
+void chip8_batch_seed(chip8_batch *b, size_t k, uint64_t seed) {
+    uint64_t z = chip8_mix(seed + 0x9E3779B97F4A7C15ULL);
+    b->rng[k] = z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+/* set instance k's whole keypad, a release ends a pending key wait the
+ * same way chip8_keyup does */
+void chip8_batch_keys(chip8_batch *b, size_t k, uint16_t keys) {
+    uint32_t released = b->keys[k] & ~(uint32_t)keys;
+    if (released && b->key_waiting[k]) {
+        int key = 0;
+        while (!(released & 1 << key))
+            key++;
+        b->key_waiting[k] = false;
+        b->v[b->register_waiting[k]][k] = key;
+    }
+    b->keys[k] = keys;
+}
+
+/* run instance k on its own for cycles more cycles */
+static void batch_run(chip8_batch *b, size_t k, uint64_t cycles, chip8_batch_stats *stats) {
+    uint64_t per_frame = b->clockspeed / 60;
+    batch_lane lane;
+    batch_gather(b, k, &lane);
+    uint64_t cycle = b->cycle[k], end = cycle + cycles;
+    while (cycle < end) {
+        uint64_t frame_end = (cycle / per_frame + 1) * per_frame;
+        uint64_t stop = frame_end < end ? frame_end : end;
+        for (; cycle < stop; cycle++)
+            lane_execute(&lane);
+        if (cycle == frame_end) {
+            if (lane.delaytimer > 0)
+                lane.delaytimer--;
+            if (lane.soundtimer > 0)
+                lane.soundtimer--;
+        }
+    }
+    b->cycle[k] = cycle;
+    batch_scatter(b, k, &lane);
+    stats->scalar += cycles;
+}
+
+/* the instruction at pc as instance k sees it */
+static uint16_t batch_fetch(const chip8_batch *b, size_t k, uint16_t pc) {
+    uint8_t hi = 0, lo = 0;
+    if (pc < MEMORY_SIZE)
+        hi = batch_page(b, k, pc >> CHIP8_PAGE_SHIFT)[pc & CHIP8_PAGE_MASK];
+    if (pc + 1 < MEMORY_SIZE)
+        lo = batch_page(b, k, (pc + 1) >> CHIP8_PAGE_SHIFT)[(pc + 1) & CHIP8_PAGE_MASK];
+    return hi << 8 | lo;
+}
+
+/* one instruction of instance k through the interpreter */
+static void batch_single(chip8_batch *b, size_t k, chip8_batch_stats *stats) {
+    batch_lane lane;
+    batch_gather(b, k, &lane);
+    lane_execute(&lane);
+    batch_scatter(b, k, &lane);
+    stats->scalar++;
+}
+
+#define EACH_LANE(k, k0, mask) \
+    for (uint32_t bits_ = (mask); bits_; bits_ &= bits_ - 1) \
+        for (size_t k = (k0) + lanes_first(bits_), once_ = 1; once_; once_ = 0)
+
+/* masked store of lanes into the uint8_t registers at p */
+static void group_store(uint8_t *p, lanes_t m, lanes_t val) {
+    lanes_store(p, lanes_select(m, lanes_load(p), val));
+}
+
+/* the 8xyn alu, the flag is written after vx like the interpreter does */
+static void group_alu(chip8_batch *b, size_t k0, lanes_t m, int x, int y, int n) {
+    uint8_t *vx = b->v[x] + k0, *vf = b->v[0xF] + k0;
+    lanes_t a = lanes_load(vx), c = lanes_load(b->v[y] + k0);
+    lanes_t one = lanes_splat(1), zero = lanes_splat(0);
+    lanes_t res, flag;
+    bool reset = b->settings.op_8xy1_2_3_reset_vf;
+    switch (n) {
+        case 0x0:
+            group_store(vx, m, c);
+            return;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+            res = n == 1 ? lanes_or(a, c) : n == 2 ? lanes_and(a, c) : lanes_xor(a, c);
+            group_store(vx, m, res);
+            if (reset)
+                group_store(vf, m, zero);
+            return;
+        case 0x4:
+            res = lanes_add(a, c);
+            /* wrapped around when the sum came out below a */
+            flag = lanes_and(lanes_xor(lanes_eq(lanes_max(a, res), res), lanes_splat(0xFF)), one);
+            break;
+        case 0x5:
+            res = lanes_sub(a, c);
+            flag = lanes_and(lanes_xor(lanes_eq(lanes_subs(a, c), zero), lanes_splat(0xFF)), one);
+            break;
+        case 0x7:
+            res = lanes_sub(c, a);
+            flag = lanes_and(lanes_xor(lanes_eq(lanes_subs(c, a), zero), lanes_splat(0xFF)), one);
+            break;
+        case 0x6:
+            if (b->settings.op_8xy6_8xye_do_vy)
+                a = c;
+            flag = lanes_and(a, one);
+            res = lanes_shr1(a);
+            break;
+        case 0xE:
+            if (b->settings.op_8xy6_8xye_do_vy)
+                a = c;
+            flag = lanes_and(lanes_eq(lanes_and(a, lanes_splat(0x80)), lanes_splat(0x80)), one);
+            res = lanes_add(a, a);
+            break;
+        default:
+            return;
+    }
+    group_store(vx, m, res);
+    group_store(vf, m, flag);
+}
+
+/* issue op at pc to the lanes in mask. register only instructions run in
+ * vector registers, simple ones go lane by lane on the batch arrays and
+ * anything touching memory or the screen through the interpreter */
+static void group_issue(chip8_batch *b, size_t k0, uint32_t mask, uint16_t pc, uint16_t op,
+        chip8_batch_stats *stats) {
+    int x = (op & 0x0F00) >> 8;
+    int y = (op & 0x00F0) >> 4;
+    int n = op & 0x000F;
+    int nn = op & 0x00FF;
+    int nnn = op & 0x0FFF;
+    uint8_t *vx = b->v[x] + k0;
+    lanes_t m = lanes_from_bits(mask);
+    uint16_t next = pc + 2;
+    uint32_t skip = 0;
+    uint16_t sink = 0;
+
+    switch (op & 0xF000) {
+        case 0x0000:
+            if (nn == 0xE0) {
+                EACH_LANE(k, k0, mask) {
+                    memset(b->screen + k * HEIGHT, 0, HEIGHT * sizeof *b->screen);
+                    b->screen_hash[k] = 0;
+                }
+            } else if (nn == 0xEE) {
+                EACH_LANE(k, k0, mask) {
+                    b->pc[k] = *batch_stack(b, --b->sp[k], k, &sink);
+                    b->instret[k]++;
+                }
+                goto issued;
+            }
+            break;
+        case 0x1000:
+            next = nnn;
+            break;
+        case 0x2000:
+            EACH_LANE(k, k0, mask)
+                *batch_stack(b, b->sp[k]++, k, &sink) = next;
+            next = nnn;
+            break;
+        case 0x3000:
+            skip = lanes_bits(lanes_eq(lanes_load(vx), lanes_splat(nn)));
+            break;
+        case 0x4000:
+            skip = ~lanes_bits(lanes_eq(lanes_load(vx), lanes_splat(nn)));
+            break;
+        case 0x5000:
+            skip = lanes_bits(lanes_eq(lanes_load(vx), lanes_load(b->v[y] + k0)));
+            break;
+        case 0x9000:
+            skip = ~lanes_bits(lanes_eq(lanes_load(vx), lanes_load(b->v[y] + k0)));
+            break;
+        case 0x6000:
+            group_store(vx, m, lanes_splat(nn));
+            break;
+        case 0x7000:
+            group_store(vx, m, lanes_add(lanes_load(vx), lanes_splat(nn)));
+            break;
+        case 0x8000:
+            group_alu(b, k0, m, x, y, n);
+            break;
+        case 0xA000:
+            EACH_LANE(k, k0, mask)
+                b->i[k] = nnn;
+            break;
+        case 0xB000:
+            EACH_LANE(k, k0, mask) {
+                b->pc[k] = b->v[0][k] + nnn;
+                b->instret[k]++;
+            }
+            goto issued;
+        case 0xC000:
+            EACH_LANE(k, k0, mask)
+                b->v[x][k] = chip8_xorshift(&b->rng[k]) & nn;
+            break;
+        case 0xE000:
+            if (nn != 0x9E && nn != 0xA1)
+                break;
+            EACH_LANE(k, k0, mask)
+                skip |= (uint32_t)((b->keys[k] & (1 << b->v[x][k])) != 0) << (k - k0);
+            if (nn == 0xA1)
+                skip = ~skip;
+            break;
+        case 0xF000:
+            switch (nn) {
+                case 0x07:
+                    group_store(vx, m, lanes_load(b->delaytimer + k0));
+                    break;
+                case 0x15:
+                    group_store(b->delaytimer + k0, m, lanes_load(vx));
+                    break;
+                case 0x18:
+                    group_store(b->soundtimer + k0, m, lanes_load(vx));
+                    break;
+                case 0x1E:
+                    EACH_LANE(k, k0, mask) {
+                        b->i[k] += b->v[x][k];
+                        b->v[0xF][k] = b->i[k] > 0x0FFF;
+                    }
+                    break;
+                case 0x29:
+                    EACH_LANE(k, k0, mask)
+                        b->i[k] = b->v[x][k] * 5;
+                    break;
+                default:
+                    goto single;
+            }
+            break;
+        default:
+            goto single;
+    }
+    EACH_LANE(k, k0, mask) {
+        b->pc[k] = skip >> (k - k0) & 1 ? next + 2 : next;
+        b->instret[k]++;
+    }
+issued:
+    stats->issued++;
+    stats->lanes += lanes_count(mask);
+    return;
+single:
+    EACH_LANE(k, k0, mask)
+        batch_single(b, k, stats);
+}
+
+/* one cycle of the group at k0, valid has a bit per instance in it */
+static void group_cycle(chip8_batch *b, size_t k0, uint32_t valid, chip8_batch_stats *stats) {
+    /* waiting lanes burn the cycle */
+    lanes_t waiting = lanes_load(b->key_waiting + k0);
+    uint32_t pending = valid & lanes_bits(lanes_eq(waiting, lanes_splat(0)));
+    while (pending) {
+        uint16_t pc = b->pc[k0 + lanes_first(pending)];
+        uint32_t mask = pending & lanes_match16(b->pc + k0, pc);
+        pending &= ~mask;
+        uint32_t at = pc >= MEMORY_SIZE ? 0 : pc >> CHIP8_PAGE_SHIFT;
+        uint32_t after = pc + 1 >= MEMORY_SIZE ? 0 : (pc + 1) >> CHIP8_PAGE_SHIFT;
+        uint16_t op = batch_fetch(b, k0 + lanes_first(mask), pc);
+        if (batch_forked(b, at) || batch_forked(b, after)) {
+            /* someone wrote near the code, lanes that see another
+             * instruction than the first one go on their own */
+            EACH_LANE(k, k0, mask) {
+                if (batch_fetch(b, k, pc) != op) {
+                    mask &= ~((uint32_t)1 << (k - k0));
+                    batch_single(b, k, stats);
+                }
+            }
+        }
+        /* halted */
+        if (op == 0 || mask == 0)
+            continue;
+        group_issue(b, k0, mask, pc, op, stats);
+    }
+}
+
+/* run the group at k0 for cycles more cycles, the same as batch_run on
+ * each of its instances */
+static void group_run(chip8_batch *b, size_t k0, uint32_t valid, uint64_t cycles,
+        chip8_batch_stats *stats) {
+    uint64_t per_frame = b->clockspeed / 60;
+    uint64_t cycle = b->cycle[k0], end = cycle + cycles;
+    lanes_t one = lanes_splat(1);
+    while (cycle < end) {
+        uint64_t frame_end = (cycle / per_frame + 1) * per_frame;
+        uint64_t stop = frame_end < end ? frame_end : end;
+        for (; cycle < stop; cycle++)
+            group_cycle(b, k0, valid, stats);
+        if (cycle == frame_end) {
+            /* the padding past the last instance ticks too, nothing reads it */
+            lanes_store(b->delaytimer + k0, lanes_subs(lanes_load(b->delaytimer + k0), one));
+            lanes_store(b->soundtimer + k0, lanes_subs(lanes_load(b->soundtimer + k0), one));
+        }
+    }
+    EACH_LANE(k, k0, valid)
+        b->cycle[k] = cycle;
+}
+
+/* run instances from to to for cycles more cycles, timers tick each time
+ * one crosses the end of a frame just as with chip8_step. from has to
+ * start a lockstep group, a multiple of CHIP8_LANES. false once the batch
+ * ran out of memory for private pages or stack, the instances are garbage
+ * then and all that is left to do with the batch is free it */
+bool chip8_batch_step_range(chip8_batch *b, size_t from, size_t to, uint64_t cycles,
+        chip8_batch_stats *stats) {
+    for (size_t k0 = from; k0 < to; k0 += CHIP8_LANES) {
+        size_t count = to - k0 < CHIP8_LANES ? to - k0 : CHIP8_LANES;
+        uint32_t valid = ((uint32_t)1 << count) - 1;
+        bool aligned = b->lockstep;
+        for (size_t k = k0 + 1; k < k0 + count && aligned; k++)
+            aligned = b->cycle[k] == b->cycle[k0];
+        if (aligned) {
+            group_run(b, k0, valid, cycles, stats);
+            continue;
+        }
+        for (size_t k = k0; k < k0 + count; k++)
+            batch_run(b, k, cycles, stats);
+    }
+    return !b->failed;
+}
+
+bool chip8_batch_step(chip8_batch *b, uint64_t cycles) {
+    return chip8_batch_step_range(b, 0, b->n, cycles, &b->stats);
+}
+
+typedef struct {
+    chip8_batch *batch;
+    uint64_t cycles;
+    chip8_batch_stats stats[POOL_MAX_THREADS];
+} batch_job;
+
+static void batch_task(void *ctx, size_t group, int worker) {
+    batch_job *job = ctx;
+    size_t from = group * CHIP8_LANES;
+    size_t to = from + CHIP8_LANES < job->batch->n ? from + CHIP8_LANES : job->batch->n;
+    chip8_batch_step_range(job->batch, from, to, job->cycles, &job->stats[worker]);
+}
+
+/* chip8_batch_step spread over pool, one lockstep group per task. the
+ * groups share nothing but the page pool, so the result is the same for
+ * any number of threads */
+bool chip8_batch_step_parallel(chip8_batch *b, pool_t *pool, uint64_t cycles) {
+    static const size_t grain = 4; /* groups per chunk */
+    batch_job *job = calloc(1, sizeof *job);
+    if (job == NULL)
+        return chip8_batch_step(b, cycles);
+    job->batch = b;
+    job->cycles = cycles;
+    pool_run(pool, (b->n + CHIP8_LANES - 1) / CHIP8_LANES, grain, batch_task, job);
+    for (int t = 0; t < pool_threads(pool); t++) {
+        b->stats.issued += job->stats[t].issued;
+        b->stats.lanes += job->stats[t].lanes;
+        b->stats.scalar += job->stats[t].scalar;
+    }
+    free(job);
+    return !b->failed;
+}
+
+/* HEIGHT rows of instance k, pixel x of a row is bit 63 - x */
+const uint64_t *chip8_batch_screen(const chip8_batch *b, size_t k) {
+    return b->screen + k * HEIGHT;
+}
+
+/* byte of instance k's memory */
+uint8_t chip8_batch_peek(const chip8_batch *b, size_t k, uint32_t addr) {
+    if (addr >= MEMORY_SIZE)
+        return 0;
+    return batch_page(b, k, addr >> CHIP8_PAGE_SHIFT)[addr & CHIP8_PAGE_MASK];
+}
+
+/* same value chip8_state_hash gives the equivalent plain chip8 */
+uint64_t chip8_batch_state_hash(const chip8_batch *b, size_t k) {
+    batch_lane lane;
+    batch_gather(b, k, &lane);
+    return lane_hash(&lane);
+}
+
+/* chunks of a pool handed out so far, in bytes */
+static size_t batch_pool_bytes(size_t len, size_t size) {
+    return (len + CHIP8_BATCH_CHUNK - 1) / CHIP8_BATCH_CHUNK * CHIP8_BATCH_CHUNK * size;
+}
+
+size_t chip8_batch_bytes(const chip8_batch *b) {
+    size_t per = 2 * sizeof *b->pc + NUM_REGISTERS + 3 + 2 * sizeof(bool)
+        + sizeof *b->keys + 5 * sizeof(uint64_t) + HEIGHT * sizeof *b->screen
+        + CHIP8_BATCH_DIRS * sizeof *b->dirs;
+    size_t rows = 0;
+    for (int d = 0; d < CHIP8_BATCH_STACK; d++)
+        rows += b->stack[d] != NULL;
+    return sizeof *b + b->n * per + ((size_t)CHIP8_PAGES << CHIP8_PAGE_SHIFT)
+        + rows * b->n * sizeof **b->stack
+        + (b->n * CHIP8_BATCH_DIRS + b->n * CHIP8_PAGES) / CHIP8_BATCH_CHUNK * sizeof *b->pool
+        + batch_pool_bytes(b->tables_len, CHIP8_BATCH_TABLE * sizeof(uint32_t))
+        + batch_pool_bytes(b->pool_len, CHIP8_PAGE_SIZE);
+}
+
+/* share of the lanes kept busy, 1 when every group stayed together.
+ * an instruction run on its own takes a whole issue for one lane, so a
+ * fleet that fell apart or runs without lockstep is at 1 / CHIP8_LANES */
+double chip8_batch_utilisation(const chip8_batch *b) {
+    uint64_t issues = b->stats.issued + b->stats.scalar;
+    if (issues == 0)
+        return 0;
+    return (double)(b->stats.lanes + b->stats.scalar) / ((double)issues * CHIP8_LANES);
+}
+
+/* write instance k out as a plain chip8 */
+void chip8_batch_flatten(const chip8_batch *b, size_t k, chip8 *dst) {
+    chip8_input_queue input = dst->input;
+    uint64_t gen = dst->mem_gen;
+    batch_lane lane;
+    batch_gather(b, k, &lane);
+    chip8_init(dst);
+    dst->input = input;
+    dst->mem_gen = gen;
+    dst->key_waiting = lane.key_waiting;
+    dst->register_waiting = lane.register_waiting;
+    dst->keys = lane.keys;
+    dst->clockspeed = b->clockspeed;
+    dst->i = lane.i;
+    dst->pc = lane.pc;
+    memcpy(dst->v, lane.v, sizeof dst->v);
+    for (int d = 0; d < CHIP8_BATCH_STACK; d++) {
+        const uint16_t *row = batch_load(&b->stack[d]);
+        dst->stack[d] = row != NULL ? row[k] : 0;
+    }
+    dst->delaytimer = lane.delaytimer;
+    dst->soundtimer = lane.soundtimer;
+    dst->sp = lane.sp;
+    dst->settings = b->settings;
+    dst->rom_size = b->rom_size;
+    dst->rng = lane.rng;
+    dst->cycle = b->cycle[k];
+    dst->instret = lane.instret;
+    for (uint32_t addr = 0; addr < MEMORY_SIZE; addr++)
+        dst->memory[addr] = lane_read(&lane, addr);
+    for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH; x++)
+            dst->screen[y][x] = lane_pixel(&lane, x, y);
+    dst->mem_hash = lane.mem_hash;
+    dst->screen_hash = lane.screen_hash;
+    chip8_touch_all(dst);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+#include "pool.h"
+
+#define CHIP8_LANES 16 /* instances in a lockstep group */
+#define CHIP8_BATCH_CHUNK 64 /* pages or tables the private pools grow by */
+#define CHIP8_BATCH_TABLE 16 /* pages a second level page table covers */
+#define CHIP8_BATCH_DIRS ((CHIP8_PAGES + CHIP8_BATCH_TABLE - 1) / CHIP8_BATCH_TABLE)
+#define CHIP8_BATCH_STACK 256 /* sp is a uint8_t, the same depth as chip8 */
+
+/* how lockstep execution is going, see chip8_batch_utilisation */
+typedef struct {
+    uint64_t issued; /* instructions issued to a group of lanes at once */
+    uint64_t lanes; /* lanes those carried between them */
+    uint64_t scalar; /* instructions run one instance at a time */
+} chip8_batch_stats;
+
+/* many instances of one rom stored a field at a time, every instance's
+ * pc next to each other, then every v0 and so on, so running the whole
+ * fleet streams through memory instead of jumping 40k between machines.
+ *
+ * memory starts out as one image shared by all of them, an instance gets
+ * a private copy of a page the first time it writes to it. an instance
+ * costs about 700 bytes (703 measured over 4096 of BRIX), plus 256 for
+ * each page it has written. screens are packed a bit per pixel, a
+ * uint64_t per row with x = 0 in the top bit.
+ * clock and quirks are the same for the whole batch, frames end at
+ * multiples of clockspeed / 60 cycles and input goes in between steps
+ * through chip8_batch_keys */
+typedef struct {
+    size_t n;
+    int clockspeed; /* at least 60, a frame is clockspeed / 60 cycles */
+    chip8_settings settings;
+    uint32_t rom_size;
+
+    /* registers, element k belongs to instance k. padded to a whole
+     * number of lockstep groups */
+    uint16_t *pc, *i;
+    uint8_t *v[NUM_REGISTERS];
+    uint8_t *sp, *delaytimer, *soundtimer;
+    bool *key_waiting, *register_waiting;
+    uint32_t *keys;
+    uint64_t *rng, *cycle, *instret;
+    uint64_t *mem_hash, *screen_hash;
+    /* depth d of instance k at stack[d][k], a depth gets its row the
+     * first time any instance reaches it */
+    uint16_t *stack[CHIP8_BATCH_STACK];
+
+    uint64_t *screen; /* HEIGHT rows per instance */
+
+    /* two level page tables. dirs[k * CHIP8_BATCH_DIRS + d] is 0 while
+     * instance k has the image's pages CHIP8_BATCH_TABLE * d on, otherwise
+     * one past the number of its table for them in tables. a table entry
+     * is 0 for the page of image and otherwise one past its number in
+     * pool. both pools are chunks of CHIP8_BATCH_CHUNK that never move once
+     * allocated, so threads stepping other instances can grow them under
+     * pool_lock */
+    uint8_t *image;
+    uint32_t *dirs;
+    uint8_t **tables;
+    size_t tables_len; /* tables handed out */
+    uint8_t **pool;
+    size_t pool_len; /* pages handed out */
+    volatile int pool_lock;
+    bool failed; /* one of them could not grow, see chip8_batch_step_range */
+    uint8_t forked[CHIP8_PAGES]; /* some instance has a copy of the page */
+
+    /* run instances in groups of CHIP8_LANES, those at the same pc
+     * issuing each instruction together. on by default where there is
+     * simd, results are the same either way */
+    bool lockstep;
+    chip8_batch_stats stats;
+} chip8_batch;
+
+chip8_batch *chip8_batch_new(const chip8 *proto, size_t n);
+void chip8_batch_free(chip8_batch *b);
+bool chip8_batch_set(chip8_batch *b, size_t k, const chip8 *src);
+void chip8_batch_seed(chip8_batch *b, size_t k, uint64_t seed);
+void chip8_batch_keys(chip8_batch *b, size_t k, uint16_t keys);
+bool chip8_batch_step(chip8_batch *b, uint64_t cycles);
+bool chip8_batch_step_range(chip8_batch *b, size_t from, size_t to, uint64_t cycles,
+        chip8_batch_stats *stats);
+bool chip8_batch_step_parallel(chip8_batch *b, pool_t *pool, uint64_t cycles);
+const uint64_t *chip8_batch_screen(const chip8_batch *b, size_t k);
+uint8_t chip8_batch_peek(const chip8_batch *b, size_t k, uint32_t addr);
+uint64_t chip8_batch_state_hash(const chip8_batch *b, size_t k);
+size_t chip8_batch_bytes(const chip8_batch *b);
+double chip8_batch_utilisation(const chip8_batch *b);
+void chip8_batch_flatten(const chip8_batch *b, size_t k, chip8 *dst);
+
+#endif /* BATCH_H_ */
@@ -8,7 +8,7 @@ void beeper_callback(void *userdata, uint8_t *stream, int len)
     short *snd = (short*)stream;
     len /= sizeof *snd;
     for(int i = 0; i < len; i++) {
-        snd[i] = 32000 * sin(beeper->time);
+        snd[i] = 32000 * beeper->volume * sin(beeper->time);
         beeper->time += beeper->freq * PI2 / 48000.0;
         if (beeper->time >= PI2)
             beeper->time -= PI2;
@@ -20,6 +20,7 @@ void beeper_init(beeper_t *beeper) {
     memset(beeper, 0, sizeof *beeper);
     beeper->time = 0;
     beeper->freq = 441;
+    beeper->volume = 1.0f;
     beeper->spec.freq = 44100;
     beeper->spec.format = AUDIO_S16SYS;
     beeper->spec.channels = 1;
@@ -20,6 +20,7 @@ struct beeper {
     bool playing;
     float time;
     float freq;
+    float volume; /* 0 to 1 */
 };
 
 void beeper_init(beeper_t *beeper);
@@ -1,239 +1,90 @@
-#include "chip8.h"
-#include <SDL2/SDL_events.h>
+#define SHEEP_LOG_IMPLEMENTATION
+#include "sheep8.h"
 #include "log.h"
+#include "movie.h"
+#include "timeline.h"
+#include "chip8_exec.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <time.h>
+
+#if defined(__GNUC__) && !defined(__TINYC__)
+#define chip8_barrier() __sync_synchronize()
+#else
+#define chip8_barrier() ((void)0)
+#endif
+
+static void chip8_input_apply(chip8 *chip, uint64_t cycle);
+
+static void chip8_mem_write(chip8 *chip, uint32_t addr, uint8_t val) {
+    if (addr >= MEMORY_SIZE)
+        return;
+    chip->mem_hash ^= chip8_mem_key(addr, chip->memory[addr]) ^ chip8_mem_key(addr, val);
+    chip->memory[addr] = val;
+    chip->page_gen[addr >> CHIP8_PAGE_SHIFT] = ++chip->mem_gen;
+}
+
+static void chip8_flip(chip8 *chip, int x, int y) {
+    chip->screen[y][x] ^= 1;
+    chip->screen_hash ^= chip8_pixel_key(x, y);
+}
+
+static void chip8_clear(chip8 *chip) {
+    memset(chip->screen, 0, sizeof chip->screen);
+    chip->screen_hash = 0;
+}
+
+#define CHIP8_EXEC_TYPE chip8
+#define CHIP8_EXEC_NAME chip8_execute
+#define CHIP8_HASH_NAME chip8_hash
+#define CHIP8_READ(c, addr) ((c)->memory[addr])
+#define CHIP8_WRITE(c, addr, val) chip8_mem_write(c, addr, val)
+#define CHIP8_PIXEL(c, x, y) ((c)->screen[y][x])
+#define CHIP8_FLIP(c, x, y) chip8_flip(c, x, y)
+#define CHIP8_CLEAR(c) chip8_clear(c)
+#include "chip8_exec.h"
 
 void chip8_init(chip8 *chip)
 {
-    srand(time(NULL));
     memset(chip, 0, sizeof *chip);
+    chip8_seed(chip, DEFAULT_SEED);
     memcpy(chip->memory, fonts, sizeof fonts);
     chip->pc = 0x200;
     chip->i = 0;
     chip->clockspeed = DEFAULT_CLOCK;
     chip->settings = chip8_default_settings;
+    chip8_touch_all(chip);
+    chip8_rehash(chip);
 }
 
-void chip8_interpret(chip8 *chip)
+/* run one machine cycle, a frame is clockspeed / 60 of them and ends with
+ * the timers ticking, returns true when this call finished the frame */
+bool chip8_step(chip8 *chip)
 {
-    for (int i = 0; i < chip->clockspeed / 60; ++i) {
-        uint16_t op = chip->memory[chip->pc] << 8 | chip->memory[chip->pc+1];
-        if (chip->key_waiting) return;
-        if (op == 0x0) return;
-
-        /* OP -> AxyB */
-        int x = (op & 0x0F00) >> 8;
-        int y = (op & 0x00F0) >> 4;
-        int n = op & 0x000F;
-        int nn = op & 0x00FF;
-        int nnn = op & 0x0FFF;
-
-        chip->pc += 2;
-        switch (op & 0xF000) {
-            case 0x0000:
-                switch (nn) {
-                    case 0xE0:
-                        /* CLR */
-                        memset(chip->screen, 0, sizeof chip->screen);
-                        break;
-                    case 0xEE:
-                        /* RET */
-                        chip->pc = chip->stack[--chip->sp];
-                        break;
-                    case 0xFA:
-                        /* COMPAT */
-                        //chip->FX55_FX65_change_I ^= 1;
-                        break;
-                    /* 0NNN - sys is not implemented as is not needed anymore */
-                }
-                break;
-            case 0x1000:
-                /* JUMP TO nnn */
-                chip->pc = nnn;
-                break;
-            case 0x2000:
-                /* call subroutine at nnn */
-                chip->stack[chip->sp++] = chip->pc;
-                chip->pc = nnn;
-                break;
-            case 0x3000:
-                /* SE Vx, byte */
-                if (chip->v[x] == nn)
-                    chip->pc += 2;
-                break;
-            case 0x4000:
-                /* SNE Vx, byte */
-                if (chip->v[x] != nn)
-                    chip->pc += 2;
-                break;
-            case 0x5000:
-                /* SE Vx, Vy */
-                if (chip->v[x] == chip->v[y])
-                    chip->pc += 2;
-                break;
-            case 0x6000:
-                chip->v[x] = nn;
-                break;
-            case 0x7000:
-                chip->v[x] += nn;
-                break;
-            case 0x8000:
-                switch (n) {
-                    case 0x0:
-                        chip->v[x] = chip->v[y];
-                        break;
-                    case 0x1:
-                        chip->v[x] |= chip->v[y];
-                        if (chip->settings.op_8xy1_2_3_reset_vf)
-                            chip->v[0xF] = 0;
-                        break;
-                    case 0x2:
-                        chip->v[x] &= chip->v[y];
-                        if (chip->settings.op_8xy1_2_3_reset_vf)
-                            chip->v[0xF] = 0;
-                        break;
-                    case 0x3:
-                        chip->v[x] ^= chip->v[y];
-                        if (chip->settings.op_8xy1_2_3_reset_vf)
-                            chip->v[0xF] = 0;
-                        break;
-                    case 0x4: {
-                        /* Vx = Vx + Vy, VF = carry */
-                        int flag = ((int)chip->v[x] + (int)chip->v[y]) > 0xFF;
-                        chip->v[x] += chip->v[y];
-                        chip->v[0xF] = flag;
-                        break;
-                              }
-                    case 0x5: {
-                        /* Vx = Vx - Vy, VF = NOT borrow */
-                        int flag = chip->v[x] > chip->v[y];
-                        chip->v[x] = chip->v[x] - chip->v[y];
-                        chip->v[0xF] = flag;
-                        break;
-                              }
-                    case 0x6: {
-                        /* Vx = Vx SHR 1 */
-                        if (chip->settings.op_8xy6_8xye_do_vy)
-                            chip->v[x] = chip->v[y];
-                        int flag =  chip->v[x] & 1;
-                        chip->v[x] >>= 1;
-                        chip->v[0xF] = flag;
-                        break;
-                              }
-                    case 0x7: {
-                        /* Vx = Vy - Vx, VF = NOT borrow */
-                        int flag = chip->v[y] > chip->v[x];
-                        chip->v[x] = chip->v[y] - chip->v[x];
-                        chip->v[0xF] = flag;
-                        break;
-                              }
-                    case 0xE: {
-                        /* Vx = Vx SHL 1 */
-                        if (chip->settings.op_8xy6_8xye_do_vy)
-                            chip->v[x] = chip->v[y];
-                        int flag =  chip->v[x] >> 7;
-                        chip->v[x] <<= 1;
-                        chip->v[0xF] = flag;
-                        break;
-                              }
-                }
-                break;
-            case 0x9000:
-                if (chip->v[x] != chip->v[y])
-                    chip->pc += 2;
-                break;
-            case 0xA000:
-                chip->i = nnn;
-                break;
-            case 0xB000:
-                chip->pc = chip->v[0] + nnn;
-                break;
-            case 0xC000:
-                chip->v[x] = (rand() % 256) & nn;
-                break;
-            case 0xD000:
-                chip->v[0xF] = 0;
-                for (int row = 0; row < n; row++) {
-                    uint8_t sprite = chip->memory[chip->i + row];
-                    for (int col = 0; col < 8; col++) {
-                        int bit = sprite >> (7 - col) & 1;
-                        uint8_t dx = chip->v[x] + col;
-                        uint8_t dy = chip->v[y] + row;
-                        if (chip->settings.screen_wrap_around) {
-                            dx %= WIDTH;
-                            dy %= HEIGHT;
-                        } else if (dx >= WIDTH || dy >= HEIGHT) {
-                            continue;
-                        }
-                        if (bit && chip->screen[dy][dx])
-                            chip->v[0xF] = 1;
-                        chip->screen[dy][dx] ^= bit;
-                    }
-                }
-                break;
-            case 0xE000:
-                switch (nn) {
-                    case 0x9E:
-                        /* SKP Vx */
-                        if (chip->keys & (1 << chip->v[x]))
-                            chip->pc += 2;
-                        break;
-                    case 0xA1:
-                        /* SKNP Vx */
-                        if (!(chip->keys & (1 << chip->v[x])))
-                            chip->pc += 2;
-                        break;
-                }
-                break;
-            case 0xF000:
-                switch (nn) {
-                    case 0x07:
-                        chip->v[x] = chip->delaytimer;
-                        break;
-                    case 0x0A:
-                        chip8_wait_for_key(chip, x);
-                        break;
-                    case 0x15:
-                        chip->delaytimer = chip->v[x];
-                        break;
-                    case 0x18:
-                        chip->soundtimer = chip->v[x];
-                        break;
-                    case 0x1E:
-                        chip->i += chip->v[x];
-                        chip->v[0xF] = chip->i > 0x0FFF;
-                        break;
-                    case 0x29:
-                        chip->i = chip->v[x] * 5;
-                        break;
-                    case 0x33:
-                        chip->memory[chip->i] = chip->v[x] / 100;
-                        chip->memory[chip->i+1] = (chip->v[x] % 100) / 10;
-                        chip->memory[chip->i+2] = chip->v[x] % 10;
-                        break;
-                    case 0x55:
-                        for (int i = 0; i <= x; i++)
-                            chip->memory[chip->i+i] = chip->v[i];
-                        if (chip->settings.op_fx55_fx65_increment)
-                            chip->i += x + 1;
-                        break;
-                    case 0x65:
-                        for (int i = 0; i <= x; i++)
-                            chip->v[i] = chip->memory[chip->i+i];
-                        if (chip->settings.op_fx55_fx65_increment)
-                            chip->i += x + 1;
-                        break;
-                }
-                break;
-            default:
-                printf("Invalid OPCODE %4x\n", op);
-                break;
-        }
+    if (!chip->in_frame) {
+        chip->frame_end = chip->cycle + chip->clockspeed / 60;
+        chip->in_frame = true;
     }
+    if (chip->cycle < chip->frame_end) {
+        chip8_input_apply(chip, chip->cycle);
+        chip8_execute(chip);
+        chip->cycle++;
+    }
+    if (chip->cycle < chip->frame_end)
+        return false;
+    /* zero cycle budget (clock below 60hz) must not starve the queue */
+    chip8_input_apply(chip, chip->cycle);
+    chip8_update_timer(chip);
+    chip->in_frame = false;
+    return true;
+}
+
+/* run the rest of the current frame */
+void chip8_interpret(chip8 *chip)
+{
+    while (!chip8_step(chip))
+        ;
 }
 
 void chip8_load_rom(chip8 *chip, uint8_t *buf, size_t size)
@@ -242,6 +93,9 @@ void chip8_load_rom(chip8 *chip, uint8_t *buf, size_t size)
     chip->i = 0;
     memset(chip->screen, 0, sizeof chip->screen);
     memcpy(chip->memory + 0x200, buf, size);
+    chip->rom_size = size;
+    chip8_touch_all(chip);
+    chip8_rehash(chip);
 }
 
 int chip8_load_rom_from_file(chip8 *chip, const char *path)
@@ -267,9 +121,59 @@ int chip8_load_rom_from_file(chip8 *chip, const char *path)
         return -1;
     }
 	fclose(rom);
+    chip->rom_size = rom_size;
+    chip8_touch_all(chip);
+    chip8_rehash(chip);
 	return 0;
 }
 
+/* every seed, zero included, is run through splitmix64 so that nearby
+ * seeds give unrelated streams and the xorshift state is never zero */
+void chip8_seed(chip8 *chip, uint64_t seed)
+{
+    uint64_t z = chip8_mix(seed + 0x9E3779B97F4A7C15ULL);
+    chip->rng = z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+uint8_t chip8_rand(chip8 *chip)
+{
+    return chip8_xorshift(&chip->rng);
+}
+
+/* fnv-1a of the rom as loaded, identifies the game a movie belongs to */
+uint64_t chip8_rom_hash(const chip8 *chip)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < chip->rom_size && 0x200 + i < MEMORY_SIZE; i++) {
+        hash ^= chip->memory[0x200 + i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* recompute mem_hash and screen_hash from scratch, needed after writing
+ * memory or the screen behind the interpreter's back */
+void chip8_rehash(chip8 *chip)
+{
+    chip->mem_hash = 0;
+    for (uint32_t addr = 0; addr < MEMORY_SIZE; addr++)
+        chip->mem_hash ^= chip8_mem_key(addr, chip->memory[addr]);
+    chip->screen_hash = 0;
+    for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH; x++)
+            if (chip->screen[y][x])
+                chip->screen_hash ^= chip8_pixel_key(x, y);
+}
+
+/* 64 bit hash of everything the program can observe. memory and screen
+ * come from the incrementally kept hashes, the registers are few enough
+ * to fold in on every call. cycle counts, pending input and settings are
+ * left out, two chips that will behave the same hash the same */
+uint64_t chip8_state_hash(const chip8 *chip)
+{
+    return chip8_hash(chip);
+}
+
 void chip8_update_timer(chip8 *chip)
 {
     if (chip->delaytimer > 0)
@@ -285,23 +189,43 @@ void chip8_wait_for_key(chip8 *chip, int reg) {
 }
 
 void chip8_save_to_file(chip8 *chip, const char *path) {
-    FILE *fp = fopen(path, "w");
+    uint8_t *buf = malloc(CHIP8_STATE_MAX);
+    if (buf == NULL) {
+        warn("Failed to allocate save buffer");
+        return;
+    }
+    size_t len = chip8_state_encode(chip, buf, CHIP8_STATE_MAX);
+    FILE *fp = fopen(path, "wb");
     if (fp == NULL) {
         warn("Failed to open file for saving");
+        free(buf);
         return;
     }
-    fwrite(chip, sizeof *chip, 1, fp);
+    if (fwrite(buf, 1, len, fp) != len)
+        warn("Failed writing save file");
     fclose(fp);
+    free(buf);
 }
 
-void chip8_restore_from_file(chip8 *chip, const char *path) {
+bool chip8_restore_from_file(chip8 *chip, const char *path) {
     FILE *fp = fopen(path, "rb");
     if (fp == NULL) {
         warn("Failed to open file for restoring");
-        return;
+        return false;
     }
-    fread(chip, sizeof *chip, 1, fp);
+    uint8_t *buf = malloc(CHIP8_STATE_MAX);
+    if (buf == NULL) {
+        warn("Failed to allocate restore buffer");
+        fclose(fp);
+        return false;
+    }
+    size_t len = fread(buf, 1, CHIP8_STATE_MAX, fp);
     fclose(fp);
+    bool ok = chip8_state_decode(chip, buf, len);
+    if (!ok)
+        warn("Invalid save file");
+    free(buf);
+    return ok;
 }
 
 bool chip8_keyisdown(chip8 *chip, int key) {
@@ -320,3 +244,111 @@ void chip8_keyup(chip8 *chip, int key) {
     chip->keys &= ~(1 << key);
 }
 
+
+bool chip8_input_push(chip8 *chip, chip8_input_event ev) {
+    chip8_input_queue *q = &chip->input;
+    uint32_t tail = q->tail;
+    if (tail - q->head == INPUT_QUEUE_SIZE)
+        return false;
+    if (q->record != NULL)
+        movie_record_event(q->record, ev);
+    if (q->trace != NULL)
+        timeline_record_event(q->trace, chip->cycle, ev);
+    q->events[tail & (INPUT_QUEUE_SIZE - 1)] = ev;
+    chip8_barrier();
+    q->tail = tail + 1;
+    return true;
+}
+
+/* apply ev right away, for when the queue is full. it is stamped with the
+ * cycle it takes effect at and still reaches the movie and timeline */
+void chip8_input_force(chip8 *chip, chip8_input_event ev) {
+    chip8_input_queue *q = &chip->input;
+    ev.cycle = chip->cycle;
+    if (q->record != NULL)
+        movie_record_event(q->record, ev);
+    if (q->trace != NULL)
+        timeline_record_event(q->trace, chip->cycle, ev);
+    if (ev.down)
+        chip8_keydown(chip, ev.key);
+    else
+        chip8_keyup(chip, ev.key);
+}
+
+/* apply every queued event due at or before cycle, in push order */
+static void chip8_input_apply(chip8 *chip, uint64_t cycle) {
+    chip8_input_queue *q = &chip->input;
+    uint32_t head = q->head;
+    while (head != q->tail) {
+        chip8_barrier();
+        chip8_input_event *ev = &q->events[head & (INPUT_QUEUE_SIZE - 1)];
+        if (ev->cycle > cycle)
+            break;
+        if (ev->down)
+            chip8_keydown(chip, ev->key);
+        else
+            chip8_keyup(chip, ev->key);
+        head++;
+        chip8_barrier();
+        q->head = head;
+    }
+}
+
+/* mark every page written, for wholesale changes to memory */
+void chip8_touch_all(chip8 *chip) {
+    chip->mem_gen++;
+    for (int p = 0; p < CHIP8_PAGES; p++)
+        chip->page_gen[p] = chip->mem_gen;
+}
+
+/* copy the bytes of chip8 from field a up to field b */
+#define chip8_copy_span(dst, src, a, b) memcpy((uint8_t*)(dst) + offsetof(chip8, a), \
+        (const uint8_t*)(src) + offsetof(chip8, a), offsetof(chip8, b) - offsetof(chip8, a))
+
+/* copy src into dst, where dst already holds the state src had when its
+ * mem_gen was since. only pages written after that are copied, pass 0 for
+ * a full copy. past the first copy the part of screen no pixel is ever
+ * drawn to and the input queue are left alone, chip8_restore keeps the
+ * queue of the chip it restores into anyway. returns the value of since
+ * for the next snapshot */
+uint64_t chip8_snapshot(chip8 *dst, const chip8 *src, uint64_t since) {
+    if (since == 0) {
+        memcpy(dst, src, sizeof *dst);
+        return src->mem_gen;
+    }
+    chip8_copy_span(dst, src, key_waiting, memory);
+    chip8_copy_span(dst, src, v, screen);
+    for (int y = 0; y < HEIGHT; y++)
+        memcpy(dst->screen[y], src->screen[y], WIDTH * sizeof **src->screen);
+    chip8_copy_span(dst, src, delaytimer, input);
+    memcpy(&dst->mem_gen, &src->mem_gen, sizeof *src - offsetof(chip8, mem_gen));
+    if (src->mem_gen <= since)
+        return src->mem_gen;
+    for (int p = 0; p < CHIP8_PAGES; p++) {
+        if (src->page_gen[p] <= since)
+            continue;
+        size_t at = (size_t)p << CHIP8_PAGE_SHIFT;
+        size_t len = at + CHIP8_PAGE_SIZE > MEMORY_SIZE ? MEMORY_SIZE - at : CHIP8_PAGE_SIZE;
+        memcpy(dst->memory + at, src->memory + at, len);
+    }
+    return src->mem_gen;
+}
+
+/* replace the state of dst with src. pending input stays with dst, and all
+ * of memory counts as written so snapshots taken of dst stay correct */
+void chip8_restore(chip8 *dst, const chip8 *src) {
+    chip8_input_queue input = dst->input;
+    uint64_t gen = dst->mem_gen > src->mem_gen ? dst->mem_gen : src->mem_gen;
+    memcpy(dst, src, sizeof *dst);
+    dst->input = input;
+    dst->mem_gen = gen;
+    chip8_touch_all(dst);
+}
+
+int sheep8_version_major(void) {
+    return SHEEP8_VERSION_MAJOR;
+}
+
+int sheep8_version_minor(void) {
+    return SHEEP8_VERSION_MINOR;
+}
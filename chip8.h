@@ -5,12 +5,19 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "rle.h"
 
 #define WIDTH 64
 #define HEIGHT 32
 #define MEMORY_SIZE 30000
 #define NUM_REGISTERS 16
 #define DEFAULT_CLOCK 700
+#define MAX_CLOCK 1000000 /* hz, far past anything a chip8 program expects */
+#define DEFAULT_SEED 0x5EEDC8
+#define INPUT_QUEUE_SIZE 64 /* must be a power of two */
+#define CHIP8_PAGE_SHIFT 8
+#define CHIP8_PAGE_SIZE (1 << CHIP8_PAGE_SHIFT)
+#define CHIP8_PAGES ((MEMORY_SIZE + CHIP8_PAGE_SIZE - 1) / CHIP8_PAGE_SIZE)
 
 typedef struct {
     bool op_8xy6_8xye_do_vy;
@@ -19,6 +26,24 @@ typedef struct {
     bool screen_wrap_around;
 } chip8_settings;
 
+typedef struct {
+    uint64_t cycle; /* machine cycle the event takes effect at */
+    uint8_t key;
+    bool down;
+} chip8_input_event;
+
+struct movie;
+struct timeline;
+
+/* single producer (event loop) single consumer (chip8_interpret) ring,
+ * head is only written by the consumer and tail only by the producer */
+typedef struct {
+    chip8_input_event events[INPUT_QUEUE_SIZE];
+    volatile uint32_t head, tail;
+    struct movie *record; /* movie capturing pushed events, if any */
+    struct timeline *trace; /* debugger history logging them, if any */
+} chip8_input_queue;
+
 typedef struct {
     bool key_waiting;
     bool register_waiting;
@@ -33,6 +58,18 @@ typedef struct {
     uint8_t delaytimer, soundtimer; /* sound timer */
     uint8_t sp; /* stack pointer */
     chip8_settings settings;
+    uint32_t rom_size; /* bytes loaded at 0x200 */
+    uint64_t rng; /* xorshift64* state, never zero */
+    uint64_t cycle; /* cycles elapsed, idle ones included */
+    uint64_t instret; /* instructions retired */
+    uint64_t frame_end; /* cycle the current frame ends at */
+    bool in_frame; /* stepped partway into a frame */
+    chip8_input_queue input;
+    /* dirty tracking, every memory write stamps its page with ++mem_gen */
+    uint64_t mem_gen;
+    uint64_t page_gen[CHIP8_PAGES];
+    /* xor of the zobrist keys of memory and of the lit pixels */
+    uint64_t mem_hash, screen_hash;
 } chip8;
 
 static const uint8_t fonts[] = {
@@ -59,12 +96,28 @@ void chip8_load_rom(chip8 *chip, uint8_t *buf, size_t size);
 int chip8_load_rom_from_file(chip8 *chip, const char* path);
 void chip8_update_timer(chip8 *chip);
 void chip8_interpret(chip8 *chip);
+bool chip8_step(chip8 *chip);
 void chip8_wait_for_key(chip8 *chip, int reg);
 void chip8_save_to_file(chip8 *chip, const char *path);
-void chip8_restore_from_file(chip8 *chip, const char *path);
+bool chip8_restore_from_file(chip8 *chip, const char *path);
+size_t chip8_state_encode(const chip8 *chip, uint8_t *buf, size_t cap);
+bool chip8_state_decode(chip8 *chip, const uint8_t *buf, size_t len);
+void chip8_seed(chip8 *chip, uint64_t seed);
+uint8_t chip8_rand(chip8 *chip);
+uint64_t chip8_rom_hash(const chip8 *chip);
+void chip8_rehash(chip8 *chip);
+uint64_t chip8_state_hash(const chip8 *chip);
 void chip8_keydown(chip8 *chip, int key);
 void chip8_keyup(chip8 *chip, int key);
 bool chip8_keyisdown(chip8 *chip, int key);
+bool chip8_input_push(chip8 *chip, chip8_input_event ev);
+void chip8_input_force(chip8 *chip, chip8_input_event ev);
+void chip8_touch_all(chip8 *chip);
+uint64_t chip8_snapshot(chip8 *dst, const chip8 *src, uint64_t since);
+void chip8_restore(chip8 *dst, const chip8 *src);
+
+/* upper bound of chip8_state_encode output */
+#define CHIP8_STATE_MAX (1024 + RLE_BOUND(MEMORY_SIZE))
 
 static const chip8_settings chip8_default_settings = {
     .op_8xy6_8xye_do_vy = true,
@@ -0,0 +1,308 @@
+/* interpreter internals shared by every chip8 memory layout, not part of
+ * the api. the first half is plain helpers, the second is a template:
+ * define the macros below and include this file to get an instruction
+ * executor and a state hash for that layout
+ *
+ *   CHIP8_EXEC_TYPE        instance type, with the register fields of chip8
+ *   CHIP8_EXEC_NAME        name of the executor, static void (type *)
+ *   CHIP8_HASH_NAME        name of the state hash, static uint64_t (const type *)
+ *   CHIP8_READ(c, addr)    memory byte at addr
+ *   CHIP8_WRITE(c, addr, val)  store a byte, keeping mem_hash up to date
+ *   CHIP8_PIXEL(c, x, y)   whether a pixel is lit
+ *   CHIP8_FLIP(c, x, y)    toggle a pixel, keeping screen_hash up to date
+ *   CHIP8_CLEAR(c)         blank the screen and zero screen_hash
+ *   CHIP8_STACK(c, d)      optional, stack entry d as an lvalue
+ */
+#ifndef CHIP8_EXEC_H_
+#define CHIP8_EXEC_H_
+
+#include <stdio.h>
+#include "chip8.h"
+
+/* splitmix64 finalizer */
+static inline uint64_t chip8_mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* zobrist keys, every (address, value) pair and every pixel stands for
+ * its own pseudo random 64 bits. state hashes are the xor of the keys of
+ * what is there, so a write only has to swap one key for another */
+static inline uint64_t chip8_mem_key(uint32_t addr, uint8_t val) {
+    return chip8_mix(((uint64_t)addr << 8 | val) + 0x9E3779B97F4A7C15ULL);
+}
+
+static inline uint64_t chip8_pixel_key(int x, int y) {
+    return chip8_mix(((uint64_t)1 << 40 | (uint64_t)y << 16 | x) + 0x9E3779B97F4A7C15ULL);
+}
+
+/* xorshift64*, same sequence on every platform for a given seed */
+static inline uint8_t chip8_xorshift(uint64_t *rng) {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return (*rng * 0x2545F4914F6CDD1DULL) >> 56;
+}
+
+#endif /* CHIP8_EXEC_H_ */
+
+#ifdef CHIP8_EXEC_TYPE
+
+#ifndef CHIP8_STACK
+#define CHIP8_STACK(c, d) ((c)->stack[d])
+#endif
+
+/* fetch and execute the instruction at pc */
+static void CHIP8_EXEC_NAME(CHIP8_EXEC_TYPE *chip)
+{
+    uint16_t op = CHIP8_READ(chip, chip->pc) << 8 | CHIP8_READ(chip, chip->pc+1);
+    /* waiting or halted, burn the cycle so later input still lands on time */
+    if (chip->key_waiting) return;
+    if (op == 0x0) return;
+    chip->instret++;
+
+    /* OP -> AxyB */
+    int x = (op & 0x0F00) >> 8;
+    int y = (op & 0x00F0) >> 4;
+    int n = op & 0x000F;
+    int nn = op & 0x00FF;
+    int nnn = op & 0x0FFF;
+
+    chip->pc += 2;
+    switch (op & 0xF000) {
+        case 0x0000:
+            switch (nn) {
+                case 0xE0:
+                    /* CLR */
+                    CHIP8_CLEAR(chip);
+                    break;
+                case 0xEE:
+                    /* RET */
+                    chip->pc = CHIP8_STACK(chip, --chip->sp);
+                    break;
+                case 0xFA:
+                    /* COMPAT */
+                    //chip->FX55_FX65_change_I ^= 1;
+                    break;
+                /* 0NNN - sys is not implemented as is not needed anymore */
+            }
+            break;
+        case 0x1000:
+            /* JUMP TO nnn */
+            chip->pc = nnn;
+            break;
+        case 0x2000:
+            /* call subroutine at nnn */
+            CHIP8_STACK(chip, chip->sp++) = chip->pc;
+            chip->pc = nnn;
+            break;
+        case 0x3000:
+            /* SE Vx, byte */
+            if (chip->v[x] == nn)
+                chip->pc += 2;
+            break;
+        case 0x4000:
+            /* SNE Vx, byte */
+            if (chip->v[x] != nn)
+                chip->pc += 2;
+            break;
+        case 0x5000:
+            /* SE Vx, Vy */
+            if (chip->v[x] == chip->v[y])
+                chip->pc += 2;
+            break;
+        case 0x6000:
+            chip->v[x] = nn;
+            break;
+        case 0x7000:
+            chip->v[x] += nn;
+            break;
+        case 0x8000:
+            switch (n) {
+                case 0x0:
+                    chip->v[x] = chip->v[y];
+                    break;
+                case 0x1:
+                    chip->v[x] |= chip->v[y];
+                    if (chip->settings.op_8xy1_2_3_reset_vf)
+                        chip->v[0xF] = 0;
+                    break;
+                case 0x2:
+                    chip->v[x] &= chip->v[y];
+                    if (chip->settings.op_8xy1_2_3_reset_vf)
+                        chip->v[0xF] = 0;
+                    break;
+                case 0x3:
+                    chip->v[x] ^= chip->v[y];
+                    if (chip->settings.op_8xy1_2_3_reset_vf)
+                        chip->v[0xF] = 0;
+                    break;
+                case 0x4: {
+                    /* Vx = Vx + Vy, VF = carry */
+                    int flag = ((int)chip->v[x] + (int)chip->v[y]) > 0xFF;
+                    chip->v[x] += chip->v[y];
+                    chip->v[0xF] = flag;
+                    break;
+                          }
+                case 0x5: {
+                    /* Vx = Vx - Vy, VF = NOT borrow */
+                    int flag = chip->v[x] > chip->v[y];
+                    chip->v[x] = chip->v[x] - chip->v[y];
+                    chip->v[0xF] = flag;
+                    break;
+                          }
+                case 0x6: {
+                    /* Vx = Vx SHR 1 */
+                    if (chip->settings.op_8xy6_8xye_do_vy)
+                        chip->v[x] = chip->v[y];
+                    int flag =  chip->v[x] & 1;
+                    chip->v[x] >>= 1;
+                    chip->v[0xF] = flag;
+                    break;
+                          }
+                case 0x7: {
+                    /* Vx = Vy - Vx, VF = NOT borrow */
+                    int flag = chip->v[y] > chip->v[x];
+                    chip->v[x] = chip->v[y] - chip->v[x];
+                    chip->v[0xF] = flag;
+                    break;
+                          }
+                case 0xE: {
+                    /* Vx = Vx SHL 1 */
+                    if (chip->settings.op_8xy6_8xye_do_vy)
+                        chip->v[x] = chip->v[y];
+                    int flag =  chip->v[x] >> 7;
+                    chip->v[x] <<= 1;
+                    chip->v[0xF] = flag;
+                    break;
+                          }
+            }
+            break;
+        case 0x9000:
+            if (chip->v[x] != chip->v[y])
+                chip->pc += 2;
+            break;
+        case 0xA000:
+            chip->i = nnn;
+            break;
+        case 0xB000:
+            chip->pc = chip->v[0] + nnn;
+            break;
+        case 0xC000:
+            chip->v[x] = chip8_xorshift(&chip->rng) & nn;
+            break;
+        case 0xD000:
+            chip->v[0xF] = 0;
+            for (int row = 0; row < n; row++) {
+                uint8_t sprite = CHIP8_READ(chip, chip->i + row);
+                for (int col = 0; col < 8; col++) {
+                    int bit = sprite >> (7 - col) & 1;
+                    uint8_t dx = chip->v[x] + col;
+                    uint8_t dy = chip->v[y] + row;
+                    if (chip->settings.screen_wrap_around) {
+                        dx %= WIDTH;
+                        dy %= HEIGHT;
+                    } else if (dx >= WIDTH || dy >= HEIGHT) {
+                        continue;
+                    }
+                    if (!bit)
+                        continue;
+                    if (CHIP8_PIXEL(chip, dx, dy))
+                        chip->v[0xF] = 1;
+                    CHIP8_FLIP(chip, dx, dy);
+                }
+            }
+            break;
+        case 0xE000:
+            switch (nn) {
+                case 0x9E:
+                    /* SKP Vx */
+                    if (chip->keys & (1 << chip->v[x]))
+                        chip->pc += 2;
+                    break;
+                case 0xA1:
+                    /* SKNP Vx */
+                    if (!(chip->keys & (1 << chip->v[x])))
+                        chip->pc += 2;
+                    break;
+            }
+            break;
+        case 0xF000:
+            switch (nn) {
+                case 0x07:
+                    chip->v[x] = chip->delaytimer;
+                    break;
+                case 0x0A:
+                    if (!chip->key_waiting) {
+                        chip->key_waiting = true;
+                        chip->register_waiting = x;
+                    }
+                    break;
+                case 0x15:
+                    chip->delaytimer = chip->v[x];
+                    break;
+                case 0x18:
+                    chip->soundtimer = chip->v[x];
+                    break;
+                case 0x1E:
+                    chip->i += chip->v[x];
+                    chip->v[0xF] = chip->i > 0x0FFF;
+                    break;
+                case 0x29:
+                    chip->i = chip->v[x] * 5;
+                    break;
+                case 0x33:
+                    CHIP8_WRITE(chip, chip->i, chip->v[x] / 100);
+                    CHIP8_WRITE(chip, chip->i+1, (chip->v[x] % 100) / 10);
+                    CHIP8_WRITE(chip, chip->i+2, chip->v[x] % 10);
+                    break;
+                case 0x55:
+                    for (int i = 0; i <= x; i++)
+                        CHIP8_WRITE(chip, chip->i+i, chip->v[i]);
+                    if (chip->settings.op_fx55_fx65_increment)
+                        chip->i += x + 1;
+                    break;
+                case 0x65:
+                    for (int i = 0; i <= x; i++)
+                        chip->v[i] = CHIP8_READ(chip, chip->i+i);
+                    if (chip->settings.op_fx55_fx65_increment)
+                        chip->i += x + 1;
+                    break;
+            }
+            break;
+        default:
+            printf("Invalid OPCODE %4x\n", op);
+            break;
+    }
+}
+
+static uint64_t CHIP8_HASH_NAME(const CHIP8_EXEC_TYPE *chip)
+{
+    uint64_t h = chip->mem_hash ^ chip8_mix(chip->screen_hash + 0x9E3779B97F4A7C15ULL);
+    h = chip8_mix(h ^ ((uint64_t)chip->pc << 48 | (uint64_t)chip->i << 32
+                | (uint64_t)chip->sp << 24 | chip->delaytimer << 16 | chip->soundtimer << 8
+                | chip->key_waiting << 1 | chip->register_waiting));
+    h = chip8_mix(h ^ chip->keys ^ chip->rng);
+    for (int r = 0; r < NUM_REGISTERS; r += 8) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; b++)
+            word |= (uint64_t)chip->v[r + b] << (8 * b);
+        h = chip8_mix(h ^ word);
+    }
+    for (int d = 0; d < chip->sp; d++)
+        h = chip8_mix(h ^ CHIP8_STACK(chip, d));
+    return h;
+}
+
+#undef CHIP8_EXEC_TYPE
+#undef CHIP8_EXEC_NAME
+#undef CHIP8_HASH_NAME
+#undef CHIP8_READ
+#undef CHIP8_WRITE
+#undef CHIP8_PIXEL
+#undef CHIP8_FLIP
+#undef CHIP8_CLEAR
+#undef CHIP8_STACK
+
+#endif /* CHIP8_EXEC_TYPE */
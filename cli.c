@@ -0,0 +1,47 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cli.h"
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* decimal, or hex and octal with the c prefixes */
+bool cli_parse_u64(const char *s, uint64_t *out) {
+    char *end;
+    *out = strtoull(s, &end, 0);
+    return *s != '\0' && *end == '\0';
+}
+
+/* cli_parse_u64 that also rejects values outside lo..hi */
+bool cli_parse_range(const char *s, uint64_t lo, uint64_t hi, uint64_t *out) {
+    return cli_parse_u64(s, out) && *out >= lo && *out <= hi;
+}
+
+/* clock speed in hz, within what a state or movie can hold */
+bool cli_parse_clock(const char *s, int *out) {
+    uint64_t hz;
+    if (!cli_parse_range(s, 1, MAX_CLOCK, &hz))
+        return false;
+    *out = (int)hz;
+    return true;
+}
+
+/* seconds on a monotonic clock */
+double cli_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* s as a json string on stdout, control characters dropped */
+void cli_json_string(const char *s) {
+    putchar('"');
+    for (const char *c = s; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            putchar('\\');
+        if ((unsigned char)*c >= 0x20)
+            putchar(*c);
+    }
+    putchar('"');
+}
@@ -0,0 +1,15 @@
+#pragma once
+#ifndef CLI_H_
+#define CLI_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* bits the command line tools share, not part of libsheep8 */
+bool cli_parse_u64(const char *s, uint64_t *out);
+bool cli_parse_range(const char *s, uint64_t lo, uint64_t hi, uint64_t *out);
+bool cli_parse_clock(const char *s, int *out);
+double cli_now(void);
+void cli_json_string(const char *s);
+
+#endif /* CLI_H_ */
@@ -0,0 +1,285 @@
+#include "cow.h"
+#include "log.h"
+#include "chip8_exec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && !defined(__TINYC__)
+#define cow_ref(page) __sync_fetch_and_add(&(page)->refs, 1)
+#define cow_unref(page) __sync_sub_and_fetch(&(page)->refs, 1)
+#else
+#define cow_ref(page) ((page)->refs++)
+#define cow_unref(page) (--(page)->refs)
+#endif
+
+#define CHIP8_PAGE_MASK (CHIP8_PAGE_SIZE - 1)
+
+/* shared by every instance and never counted, most of memory is blank
+ * and forking shouldn't have to touch it */
+static chip8_page cow_blank;
+
+static chip8_page *cow_share(chip8_page *page) {
+    if (page != &cow_blank)
+        cow_ref(page);
+    return page;
+}
+
+static void cow_release(chip8_page *page) {
+    if (page != NULL && page != &cow_blank && cow_unref(page) == 0)
+        free(page);
+}
+
+/* a page holding buf, or the blank page when buf is all zero */
+static chip8_page *cow_page(const uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len && buf[n] == 0)
+        n++;
+    if (n == len)
+        return cow_share(&cow_blank);
+    chip8_page *page = calloc(1, sizeof *page);
+    if (page == NULL)
+        return NULL;
+    memcpy(page->data, buf, len);
+    page->refs = 1;
+    return page;
+}
+
+/* make the page in slot private before writing to it, NULL with cow
+ * marked failed if there is no memory for the copy */
+static chip8_page *cow_own(chip8_cow *cow, chip8_page **slot) {
+    chip8_page *page = *slot;
+    if (page != &cow_blank && page->refs == 1)
+        return page;
+    chip8_page *copy = malloc(sizeof *copy);
+    if (copy == NULL) {
+        cow->failed = true;
+        return NULL;
+    }
+    memcpy(copy->data, page->data, CHIP8_PAGE_SIZE);
+    copy->refs = 1;
+    cow_release(page);
+    return *slot = copy;
+}
+
+static uint8_t cow_read(const chip8_cow *cow, uint32_t addr) {
+    if (addr >= MEMORY_SIZE)
+        return 0;
+    return cow->memory[addr >> CHIP8_PAGE_SHIFT]->data[addr & CHIP8_PAGE_MASK];
+}
+
+static void cow_write(chip8_cow *cow, uint32_t addr, uint8_t val) {
+    if (addr >= MEMORY_SIZE)
+        return;
+    uint8_t old = cow->memory[addr >> CHIP8_PAGE_SHIFT]->data[addr & CHIP8_PAGE_MASK];
+    /* storing what is already there must not unshare the page */
+    if (old == val)
+        return;
+    chip8_page *page = cow_own(cow, &cow->memory[addr >> CHIP8_PAGE_SHIFT]);
+    if (page == NULL)
+        return;
+    page->data[addr & CHIP8_PAGE_MASK] = val;
+    cow->mem_hash ^= chip8_mem_key(addr, old) ^ chip8_mem_key(addr, val);
+}
+
+static bool cow_pixel(const chip8_cow *cow, int x, int y) {
+    int at = y * WIDTH + x;
+    return cow->screen[at >> CHIP8_PAGE_SHIFT]->data[at & CHIP8_PAGE_MASK];
+}
+
+static void cow_flip(chip8_cow *cow, int x, int y) {
+    int at = y * WIDTH + x;
+    chip8_page *page = cow_own(cow, &cow->screen[at >> CHIP8_PAGE_SHIFT]);
+    if (page == NULL)
+        return;
+    page->data[at & CHIP8_PAGE_MASK] ^= 1;
+    cow->screen_hash ^= chip8_pixel_key(x, y);
+}
+
+static void cow_clear(chip8_cow *cow) {
+    for (size_t p = 0; p < CHIP8_SCREEN_PAGES; p++) {
+        if (cow->screen[p] == &cow_blank)
+            continue;
+        cow_release(cow->screen[p]);
+        cow->screen[p] = cow_share(&cow_blank);
+    }
+    cow->screen_hash = 0;
+}
+
+#define CHIP8_EXEC_TYPE chip8_cow
+#define CHIP8_EXEC_NAME cow_execute
+#define CHIP8_HASH_NAME cow_hash
+#define CHIP8_READ(c, addr) cow_read(c, addr)
+#define CHIP8_WRITE(c, addr, val) cow_write(c, addr, val)
+#define CHIP8_PIXEL(c, x, y) cow_pixel(c, x, y)
+#define CHIP8_FLIP(c, x, y) cow_flip(c, x, y)
+#define CHIP8_CLEAR(c) cow_clear(c)
+#include "chip8_exec.h"
+
+/* fork a plain chip8. its memory and screen are split into pages once,
+ * forks of the result then only copy registers and page pointers */
+chip8_cow *chip8_fork(const chip8 *parent) {
+    chip8_cow *cow = calloc(1, sizeof *cow);
+    if (cow == NULL)
+        return NULL;
+    cow->key_waiting = parent->key_waiting;
+    cow->register_waiting = parent->register_waiting;
+    cow->keys = parent->keys;
+    cow->clockspeed = parent->clockspeed;
+    cow->i = parent->i;
+    cow->pc = parent->pc;
+    memcpy(cow->v, parent->v, sizeof cow->v);
+    memcpy(cow->stack, parent->stack, sizeof cow->stack);
+    cow->delaytimer = parent->delaytimer;
+    cow->soundtimer = parent->soundtimer;
+    cow->sp = parent->sp;
+    cow->settings = parent->settings;
+    cow->rom_size = parent->rom_size;
+    cow->rng = parent->rng;
+    cow->cycle = parent->cycle;
+    cow->instret = parent->instret;
+    cow->mem_hash = parent->mem_hash;
+    cow->screen_hash = parent->screen_hash;
+
+    bool ok = true;
+    for (int p = 0; p < CHIP8_PAGES && ok; p++) {
+        size_t at = (size_t)p << CHIP8_PAGE_SHIFT;
+        size_t len = at + CHIP8_PAGE_SIZE > MEMORY_SIZE ? MEMORY_SIZE - at : CHIP8_PAGE_SIZE;
+        ok = (cow->memory[p] = cow_page(parent->memory + at, len)) != NULL;
+    }
+    uint8_t buf[CHIP8_PAGE_SIZE];
+    for (size_t p = 0; p < CHIP8_SCREEN_PAGES && ok; p++) {
+        size_t len = 0;
+        for (size_t at = p << CHIP8_PAGE_SHIFT; at < CHIP8_SCREEN_BYTES && len < CHIP8_PAGE_SIZE; at++)
+            buf[len++] = parent->screen[at / WIDTH][at % WIDTH];
+        ok = (cow->screen[p] = cow_page(buf, len)) != NULL;
+    }
+    if (!ok) {
+        warn("Failed to allocate forked chip8");
+        chip8_cow_free(cow);
+        return NULL;
+    }
+    return cow;
+}
+
+chip8_cow *chip8_cow_fork(const chip8_cow *parent) {
+    chip8_cow *cow = malloc(sizeof *cow);
+    if (cow == NULL)
+        return NULL;
+    memcpy(cow, parent, sizeof *cow);
+    for (int p = 0; p < CHIP8_PAGES; p++)
+        cow_share(cow->memory[p]);
+    for (size_t p = 0; p < CHIP8_SCREEN_PAGES; p++)
+        cow_share(cow->screen[p]);
+    return cow;
+}
+
+void chip8_cow_free(chip8_cow *cow) {
+    if (cow == NULL)
+        return;
+    for (int p = 0; p < CHIP8_PAGES; p++)
+        cow_release(cow->memory[p]);
+    for (size_t p = 0; p < CHIP8_SCREEN_PAGES; p++)
+        cow_release(cow->screen[p]);
+    free(cow);
+}
+
+/* one frame, cover may be NULL. inlined into both callers so the plain
+ * one pays nothing for coverage */
+static inline bool cow_frame(chip8_cow *cow, uint32_t *cover, uint32_t stamp) {
+    uint64_t frame_end = cow->cycle + cow->clockspeed / 60;
+    for (; cow->cycle < frame_end && !cow->failed; cow->cycle++) {
+        uint16_t pc = cow->pc;
+        uint64_t instret = cow->instret;
+        cow_execute(cow);
+        /* cycles burned waiting for a key or halted on 0000 ran nothing */
+        if (cover != NULL && cow->instret != instret && pc < MEMORY_SIZE)
+            cover[pc] = stamp;
+    }
+    if (cow->delaytimer > 0)
+        cow->delaytimer--;
+    if (cow->soundtimer > 0)
+        cow->soundtimer--;
+    return !cow->failed;
+}
+
+/* one frame, the same as chip8_interpret with no input pending. false
+ * once a page could not be copied, cow is then only good for freeing */
+bool chip8_cow_interpret(chip8_cow *cow) {
+    return cow_frame(cow, NULL, 0);
+}
+
+/* chip8_cow_interpret that also sets cover[pc] to stamp for each
+ * instruction it retires, cover has MEMORY_SIZE entries */
+bool chip8_cow_interpret_cover(chip8_cow *cow, uint32_t *cover, uint32_t stamp) {
+    return cow_frame(cow, cover, stamp);
+}
+
+/* byte of cow's memory */
+uint8_t chip8_cow_peek(const chip8_cow *cow, uint32_t addr) {
+    return cow_read(cow, addr);
+}
+
+/* set the whole keypad, a release ends a pending key wait the same way
+ * chip8_keyup does */
+void chip8_cow_keys(chip8_cow *cow, uint16_t keys) {
+    uint32_t released = cow->keys & ~(uint32_t)keys;
+    if (released && cow->key_waiting) {
+        int key = 0;
+        while (!(released & 1 << key))
+            key++;
+        cow->key_waiting = false;
+        cow->v[cow->register_waiting] = key;
+    }
+    cow->keys = keys;
+}
+
+/* same value chip8_state_hash gives the equivalent plain chip8 */
+uint64_t chip8_cow_state_hash(const chip8_cow *cow) {
+    return cow_hash(cow);
+}
+
+/* memory held by cow alone, registers plus pages nobody else shares */
+size_t chip8_cow_bytes(const chip8_cow *cow) {
+    size_t bytes = sizeof *cow;
+    for (int p = 0; p < CHIP8_PAGES; p++)
+        if (cow->memory[p] != &cow_blank && cow->memory[p]->refs == 1)
+            bytes += sizeof(chip8_page);
+    for (size_t p = 0; p < CHIP8_SCREEN_PAGES; p++)
+        if (cow->screen[p] != &cow_blank && cow->screen[p]->refs == 1)
+            bytes += sizeof(chip8_page);
+    return bytes;
+}
+
+/* write cow out as a plain chip8, for savestates or to keep playing it */
+void chip8_cow_flatten(const chip8_cow *cow, chip8 *dst) {
+    chip8_input_queue input = dst->input;
+    uint64_t gen = dst->mem_gen;
+    chip8_init(dst);
+    dst->input = input;
+    dst->mem_gen = gen;
+    dst->key_waiting = cow->key_waiting;
+    dst->register_waiting = cow->register_waiting;
+    dst->keys = cow->keys;
+    dst->clockspeed = cow->clockspeed;
+    dst->i = cow->i;
+    dst->pc = cow->pc;
+    memcpy(dst->v, cow->v, sizeof dst->v);
+    memcpy(dst->stack, cow->stack, sizeof dst->stack);
+    dst->delaytimer = cow->delaytimer;
+    dst->soundtimer = cow->soundtimer;
+    dst->sp = cow->sp;
+    dst->settings = cow->settings;
+    dst->rom_size = cow->rom_size;
+    dst->rng = cow->rng;
+    dst->cycle = cow->cycle;
+    dst->instret = cow->instret;
+    for (uint32_t addr = 0; addr < MEMORY_SIZE; addr++)
+        dst->memory[addr] = cow_read(cow, addr);
+    for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH; x++)
+            dst->screen[y][x] = cow_pixel(cow, x, y);
+    dst->mem_hash = cow->mem_hash;
+    dst->screen_hash = cow->screen_hash;
+    chip8_touch_all(dst);
+}
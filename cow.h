@@ -0,0 +1,58 @@
+#pragma once
+#ifndef COW_H_
+#define COW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+/* the visible screen at a byte a pixel */
+#define CHIP8_SCREEN_BYTES (HEIGHT * WIDTH)
+#define CHIP8_SCREEN_PAGES ((CHIP8_SCREEN_BYTES + CHIP8_PAGE_SIZE - 1) / CHIP8_PAGE_SIZE)
+
+/* reference counted page, shared until someone writes to it. pages that
+ * are all zero point at one static blank page */
+typedef struct {
+    uint32_t refs;
+    uint8_t data[CHIP8_PAGE_SIZE];
+} chip8_page;
+
+/* copy-on-write chip8 for tree search. registers are private, memory and
+ * screen pages are shared with the parent until either side writes. field
+ * names follow chip8 so the same interpreter runs both. input goes in
+ * between frames through chip8_cow_keys, there is no queue */
+typedef struct {
+    bool key_waiting;
+    bool register_waiting;
+    uint32_t keys;
+    int clockspeed;
+    uint16_t i;
+    uint16_t pc;
+    uint8_t v[NUM_REGISTERS];
+    uint16_t stack[256];
+    uint8_t delaytimer, soundtimer;
+    uint8_t sp;
+    chip8_settings settings;
+    uint32_t rom_size;
+    uint64_t rng;
+    uint64_t cycle;
+    uint64_t instret;
+    uint64_t mem_hash, screen_hash;
+    bool failed; /* a page could not be copied, see chip8_cow_interpret */
+    chip8_page *memory[CHIP8_PAGES];
+    chip8_page *screen[CHIP8_SCREEN_PAGES];
+} chip8_cow;
+
+chip8_cow *chip8_fork(const chip8 *parent);
+chip8_cow *chip8_cow_fork(const chip8_cow *parent);
+void chip8_cow_free(chip8_cow *cow);
+bool chip8_cow_interpret(chip8_cow *cow);
+bool chip8_cow_interpret_cover(chip8_cow *cow, uint32_t *cover, uint32_t stamp);
+uint8_t chip8_cow_peek(const chip8_cow *cow, uint32_t addr);
+void chip8_cow_keys(chip8_cow *cow, uint16_t keys);
+uint64_t chip8_cow_state_hash(const chip8_cow *cow);
+size_t chip8_cow_bytes(const chip8_cow *cow);
+void chip8_cow_flatten(const chip8_cow *cow, chip8 *dst);
+
+#endif /* COW_H_ */
@@ -0,0 +1,136 @@
+#define SDL_DISABLE_IMMINTRIN_H
+#include "dialog.h"
+#include "tinyfiledialogs.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static char *dialog_run(enum dialog_kind kind) {
+    const char *path = NULL;
+    switch (kind) {
+        case dialog_load_rom: /* FALLTHROUGH */
+        case dialog_add_instance:
+            path = tinyfd_openFileDialog("Select rom file", "", 1, (const char *[]){ "*" },
+                    "binary file (chip8 rom)", false);
+            break;
+        case dialog_save_state:
+            path = tinyfd_saveFileDialog("Select where to save", "state", 1,
+                    (const char *[]){ "*" }, "binary file");
+            break;
+        case dialog_load_state:
+            path = tinyfd_openFileDialog("Select saved file", "", 1, (const char *[]){ "*" },
+                    "binary file", false);
+            break;
+        case dialog_save_movie:
+            path = tinyfd_saveFileDialog("Select where to save the movie", "movie.s8mv", 1,
+                    (const char *[]){ "*.s8mv" }, "sheep8 movie");
+            break;
+        case dialog_load_movie:
+            path = tinyfd_openFileDialog("Select movie", "", 1, (const char *[]){ "*.s8mv" },
+                    "sheep8 movie", false);
+            break;
+    }
+    if (path == NULL)
+        return NULL;
+    /* tinyfd returns a static buffer, copy it before the next dialog reuses it */
+    size_t len = strlen(path) + 1;
+    char *copy = malloc(len);
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, path, len);
+    return copy;
+}
+
+static int dialog_thread(void *userdata) {
+    dialog_t *dialog = userdata;
+    SDL_LockMutex(dialog->lock);
+    while (!dialog->quit) {
+        if (!dialog->pending) {
+            SDL_CondWait(dialog->cond, dialog->lock);
+            continue;
+        }
+        enum dialog_kind kind = dialog->request;
+        dialog->pending = false;
+        SDL_UnlockMutex(dialog->lock);
+
+        char *path = dialog_run(kind);
+
+        SDL_LockMutex(dialog->lock);
+        dialog->done[dialog->done_tail % DIALOG_QUEUE_SIZE] = (dialog_result){ kind, path };
+        dialog->done_tail++;
+        dialog->busy = false;
+    }
+    SDL_UnlockMutex(dialog->lock);
+    return 0;
+}
+
+void dialog_init(dialog_t *dialog) {
+    memset(dialog, 0, sizeof *dialog);
+    dialog->lock = SDL_CreateMutex();
+    dialog->cond = SDL_CreateCond();
+    dialog->thread = SDL_CreateThread(dialog_thread, "dialog", dialog);
+    if (dialog->thread == NULL)
+        warn("Failed to create dialog thread, file dialogs are disabled");
+}
+
+/* returns false if a dialog is already open */
+bool dialog_open(dialog_t *dialog, enum dialog_kind kind) {
+    bool opened = false;
+    if (dialog->thread == NULL)
+        return false;
+    SDL_LockMutex(dialog->lock);
+    /* completion queue full means the main loop stopped draining it */
+    if (!dialog->busy && dialog->done_tail - dialog->done_head < DIALOG_QUEUE_SIZE) {
+        dialog->busy = dialog->pending = true;
+        dialog->request = kind;
+        SDL_CondSignal(dialog->cond);
+        opened = true;
+    }
+    SDL_UnlockMutex(dialog->lock);
+    return opened;
+}
+
+bool dialog_poll(dialog_t *dialog, dialog_result *res) {
+    bool got = false;
+    if (dialog->thread == NULL)
+        return false;
+    SDL_LockMutex(dialog->lock);
+    if (dialog->done_head != dialog->done_tail) {
+        *res = dialog->done[dialog->done_head % DIALOG_QUEUE_SIZE];
+        dialog->done_head++;
+        got = true;
+    }
+    SDL_UnlockMutex(dialog->lock);
+    return got;
+}
+
+bool dialog_busy(dialog_t *dialog) {
+    if (dialog->thread == NULL)
+        return false;
+    SDL_LockMutex(dialog->lock);
+    bool busy = dialog->busy;
+    SDL_UnlockMutex(dialog->lock);
+    return busy;
+}
+
+void dialog_clean(dialog_t *dialog) {
+    if (dialog->thread == NULL)
+        return;
+    SDL_LockMutex(dialog->lock);
+    dialog->quit = true;
+    bool busy = dialog->busy;
+    SDL_CondSignal(dialog->cond);
+    SDL_UnlockMutex(dialog->lock);
+    if (busy) {
+        /* still stuck in zenity or friends, don't hold up exit for it */
+        SDL_DetachThread(dialog->thread);
+        return;
+    }
+    SDL_WaitThread(dialog->thread, NULL);
+    for (; dialog->done_head != dialog->done_tail; dialog->done_head++)
+        free(dialog->done[dialog->done_head % DIALOG_QUEUE_SIZE].path);
+    SDL_DestroyCond(dialog->cond);
+    SDL_DestroyMutex(dialog->lock);
+}
+
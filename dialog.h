@@ -0,0 +1,47 @@
+#pragma once
+#ifndef DIALOG_H_
+#define DIALOG_H_
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#define DIALOG_QUEUE_SIZE 8
+
+enum dialog_kind {
+    dialog_load_rom,
+    dialog_save_state,
+    dialog_load_state,
+    dialog_add_instance,
+    dialog_save_movie,
+    dialog_load_movie,
+};
+
+typedef struct {
+    enum dialog_kind kind;
+    char *path; /* NULL if the user cancelled, owned by the caller */
+} dialog_result;
+
+typedef struct dialog dialog_t;
+
+/* runs tinyfiledialogs on a worker thread, chosen paths come back through
+ * a completion queue drained by the main loop with dialog_poll */
+struct dialog {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    bool quit;
+    bool busy; /* tinyfd is not reentrant, only one dialog at a time */
+    bool pending;
+    enum dialog_kind request;
+    dialog_result done[DIALOG_QUEUE_SIZE];
+    int done_head, done_tail;
+};
+
+void dialog_init(dialog_t *dialog);
+bool dialog_open(dialog_t *dialog, enum dialog_kind kind);
+bool dialog_poll(dialog_t *dialog, dialog_result *res);
+bool dialog_busy(dialog_t *dialog);
+void dialog_clean(dialog_t *dialog);
+
+#endif /* DIALOG_H_ */
+
@@ -0,0 +1,211 @@
+#include "env.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+env_t *env_new(const chip8 *proto, const env_config *cfg) {
+    if (cfg->n == 0 || cfg->nrewards < 0 || cfg->nrewards > ENV_MAX_REWARDS) {
+        warn("Bad environment config");
+        return NULL;
+    }
+    env_t *env = calloc(1, sizeof *env);
+    if (env == NULL)
+        return NULL;
+    env->cfg = *cfg;
+    if (env->cfg.frameskip < 1)
+        env->cfg.frameskip = 1;
+    env->proto = *proto;
+    env->proto.input.record = NULL;
+    env->proto.input.trace = NULL;
+
+    size_t n = cfg->n;
+    bool ok = true;
+    if (cfg->action_count > 0) {
+        ok = (env->action_keys = malloc(cfg->action_count * sizeof *env->action_keys)) != NULL;
+        if (ok)
+            memcpy(env->action_keys, cfg->action_keys, cfg->action_count * sizeof *env->action_keys);
+        env->cfg.action_keys = env->action_keys;
+    }
+    ok = ok && (env->seeds = calloc(n, sizeof *env->seeds)) != NULL;
+    ok = ok && (env->episodes = calloc(n, sizeof *env->episodes)) != NULL;
+    ok = ok && (env->frames = calloc(n, sizeof *env->frames)) != NULL;
+    ok = ok && (env->scores = calloc(n, sizeof *env->scores)) != NULL;
+    ok = ok && (env->finished = calloc(n, sizeof *env->finished)) != NULL;
+    ok = ok && (env->batch = chip8_batch_new(&env->proto, n)) != NULL;
+    if (!ok) {
+        warn("Failed to allocate an environment of %zu instances", n);
+        env_free(env);
+        return NULL;
+    }
+    if (cfg->threads != 1)
+        env->pool = pool_new(cfg->threads);
+    for (size_t k = 0; k < n; k++)
+        env->seeds[k] = k;
+    return env;
+}
+
+void env_free(env_t *env) {
+    if (env == NULL)
+        return;
+    pool_free(env->pool);
+    chip8_batch_free(env->batch);
+    free(env->action_keys);
+    free(env->seeds);
+    free(env->episodes);
+    free(env->frames);
+    free(env->scores);
+    free(env->finished);
+    free(env);
+}
+
+size_t env_obs_size(const env_t *env) {
+    return env->cfg.obs == env_obs_bits ? HEIGHT * WIDTH / 8 : HEIGHT * WIDTH;
+}
+
+static float env_score_of(const env_t *env, size_t k) {
+    const chip8_batch *b = env->batch;
+    float total = 0;
+    for (int r = 0; r < env->cfg.nrewards; r++) {
+        const env_reward *rw = &env->cfg.rewards[r];
+        int32_t score = chip8_batch_peek(b, k, rw->addr);
+        if (rw->kind == env_score_word)
+            score = score << 8 | chip8_batch_peek(b, k, rw->addr + 1);
+        else if (rw->kind == env_score_bcd)
+            score = score * 100 + chip8_batch_peek(b, k, rw->addr + 1) * 10
+                + chip8_batch_peek(b, k, rw->addr + 2);
+        total += rw->scale * score;
+    }
+    return total;
+}
+
+static void env_write_obs(const env_t *env, size_t k, uint8_t *obs) {
+    const uint64_t *rows = chip8_batch_screen(env->batch, k);
+    uint8_t *out = obs + k * env_obs_size(env);
+    for (int y = 0; y < HEIGHT; y++) {
+        uint64_t row = rows[y];
+        if (env->cfg.obs == env_obs_bits) {
+            for (int byte = 0; byte < WIDTH / 8; byte++)
+                *out++ = row >> (56 - 8 * byte);
+        } else {
+            for (int x = 0; x < WIDTH; x++)
+                *out++ = row >> (63 - x) & 1;
+        }
+    }
+}
+
+/* start instance k's next episode, its clock keeps counting so that it
+ * stays in step with the rest of its lockstep group. running out of
+ * memory marks the batch failed, callers check that once at the end */
+static void env_reset_one(env_t *env, size_t k) {
+    chip8_batch *b = env->batch;
+    uint64_t cycle = b->cycle[k];
+    chip8_batch_set(b, k, &env->proto);
+    b->cycle[k] = cycle;
+    chip8_batch_seed(b, k, env->seeds[k] + env->episodes[k] * 0x9E3779B97F4A7C15ULL);
+    env->frames[k] = 0;
+    env->finished[k] = 0;
+    env->scores[k] = env_score_of(env, k);
+}
+
+static bool env_halted(const chip8_batch *b, size_t k) {
+    return !b->key_waiting[k] && chip8_batch_peek(b, k, b->pc[k]) == 0
+        && chip8_batch_peek(b, k, b->pc[k] + 1) == 0;
+}
+
+typedef struct {
+    env_t *env;
+    const int32_t *actions;
+    uint8_t *obs;
+    float *rewards;
+    uint8_t *dones;
+    chip8_batch_stats stats[POOL_MAX_THREADS];
+} env_job;
+
+/* step one lockstep group and collect what came out of it */
+static void env_task(void *ctx, size_t group, int worker) {
+    env_job *job = ctx;
+    env_t *env = job->env;
+    chip8_batch *b = env->batch;
+    size_t from = group * CHIP8_LANES;
+    size_t to = from + CHIP8_LANES < b->n ? from + CHIP8_LANES : b->n;
+
+    for (size_t k = from; k < to; k++) {
+        if (env->finished[k]) {
+            env->episodes[k]++;
+            env_reset_one(env, k);
+        }
+        int32_t action = job->actions != NULL ? job->actions[k] : 0;
+        uint16_t keys = action;
+        if (env->cfg.action_count > 0)
+            keys = action >= 0 && (size_t)action < env->cfg.action_count ? env->action_keys[action] : 0;
+        chip8_batch_keys(b, k, keys);
+    }
+    chip8_batch_step_range(b, from, to, (uint64_t)env->cfg.frameskip * (b->clockspeed / 60),
+            &job->stats[worker]);
+
+    for (size_t k = from; k < to; k++) {
+        env->frames[k] += env->cfg.frameskip;
+        float score = env_score_of(env, k);
+        if (job->rewards != NULL)
+            job->rewards[k] = score - env->scores[k];
+        env->scores[k] = score;
+
+        uint8_t done = 0;
+        if (env->cfg.done_addr >= 0
+                && chip8_batch_peek(b, k, env->cfg.done_addr) == env->cfg.done_value)
+            done |= ENV_TERMINATED;
+        if (env->cfg.done_on_halt && env_halted(b, k))
+            done |= ENV_TERMINATED;
+        if (env->cfg.max_frames > 0 && env->frames[k] >= env->cfg.max_frames)
+            done |= ENV_TRUNCATED;
+        env->finished[k] = done != 0;
+        if (job->dones != NULL)
+            job->dones[k] = done;
+        if (job->obs != NULL)
+            env_write_obs(env, k, job->obs);
+    }
+}
+
+/* start every instance over, seeds may be NULL to keep the ones from the
+ * last reset (0 to n - 1 at first). obs gets the initial observations.
+ * false if the batch ran out of memory, env is of no further use then */
+bool env_reset(env_t *env, const uint64_t *seeds, uint8_t *obs) {
+    for (size_t k = 0; k < env->cfg.n; k++) {
+        if (seeds != NULL)
+            env->seeds[k] = seeds[k];
+        env->episodes[k] = 0;
+        env_reset_one(env, k);
+        /* back in step with the group, a batch starts at the proto's cycle */
+        env->batch->cycle[k] = env->proto.cycle;
+        if (obs != NULL)
+            env_write_obs(env, k, obs);
+    }
+    return !env->batch->failed;
+}
+
+/* hold actions[k] on instance k for frameskip frames. obs takes n times
+ * env_obs_size bytes, rewards and dones n entries each, any may be NULL.
+ * false if memory ran out, either for the step or in the batch, which
+ * leaves env of no further use */
+bool env_step(env_t *env, const int32_t *actions, uint8_t *obs, float *rewards, uint8_t *dones) {
+    env_job *job = calloc(1, sizeof *job);
+    if (job == NULL) {
+        warn("Out of memory stepping the environment");
+        return false;
+    }
+    job->env = env;
+    job->actions = actions;
+    job->obs = obs;
+    job->rewards = rewards;
+    job->dones = dones;
+    pool_run(env->pool, (env->cfg.n + CHIP8_LANES - 1) / CHIP8_LANES, 4, env_task, job);
+    chip8_batch_stats *total = &env->batch->stats;
+    for (int t = 0; t < pool_threads(env->pool); t++) {
+        total->issued += job->stats[t].issued;
+        total->lanes += job->stats[t].lanes;
+        total->scalar += job->stats[t].scalar;
+    }
+    free(job);
+    return !env->batch->failed;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef ENV_H_
+#define ENV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+#include "batch.h"
+#include "pool.h"
+
+#define ENV_MAX_REWARDS 8
+
+/* observation layouts, per instance */
+enum env_obs {
+    env_obs_bits, /* HEIGHT * WIDTH / 8 bytes, rows top down, x = 0 in the top bit */
+    env_obs_bytes, /* HEIGHT * WIDTH bytes of 0 or 1 */
+};
+
+/* how a score is stored in memory */
+enum env_score {
+    env_score_byte,
+    env_score_word, /* two bytes, big endian like the chip8 */
+    env_score_bcd, /* three bytes of decimal digits as fx33 writes them */
+};
+
+/* reward is scale times how much the score at addr went up */
+typedef struct {
+    uint16_t addr;
+    enum env_score kind;
+    float scale;
+} env_reward;
+
+/* bits of the dones output */
+#define ENV_TERMINATED 1
+#define ENV_TRUNCATED 2
+
+typedef struct {
+    size_t n; /* instances */
+    int frameskip; /* frames each action is held for, at least 1 */
+    enum env_obs obs;
+    /* actions index this table of keypads, or are keypads themselves
+     * (bit k for key k) when action_count is 0 */
+    const uint16_t *action_keys;
+    size_t action_count;
+    env_reward rewards[ENV_MAX_REWARDS];
+    int nrewards;
+    int done_addr; /* episode ends once this byte reads done_value, -1 for never */
+    uint8_t done_value;
+    bool done_on_halt; /* or once the program halts on 0000 */
+    uint64_t max_frames; /* episodes are cut off after this many, 0 for no limit */
+    int threads; /* 1 runs on the caller, 0 uses every core */
+} env_config;
+
+typedef struct env env_t;
+
+/* many copies of one rom driven as a vectorized reinforcement learning
+ * environment. instances run in a chip8_batch, a step holds each one's
+ * action for frameskip frames and writes observations, rewards and dones
+ * straight into caller arrays. an instance that finished is reset at the
+ * start of the next step, with the next seed of its sequence, and takes
+ * that step's action from its initial state */
+struct env {
+    env_config cfg;
+    uint16_t *action_keys; /* copy of cfg.action_keys */
+    chip8 proto; /* every episode starts from this */
+    chip8_batch *batch;
+    pool_t *pool;
+    /* per instance */
+    uint64_t *seeds, *episodes, *frames;
+    float *scores; /* weighted score at the end of the last step */
+    uint8_t *finished;
+};
+
+env_t *env_new(const chip8 *proto, const env_config *cfg);
+void env_free(env_t *env);
+size_t env_obs_size(const env_t *env);
+bool env_reset(env_t *env, const uint64_t *seeds, uint8_t *obs);
+bool env_step(env_t *env, const int32_t *actions, uint8_t *obs, float *rewards, uint8_t *dones);
+
+#endif /* ENV_H_ */
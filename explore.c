@@ -0,0 +1,479 @@
+#define _POSIX_C_SOURCE 200809L
+#include "sheep8.h"
+#include "log.h"
+#include "cli.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* sheep8-explore, breadth first search over the states a rom can reach.
+ * every step holds one keypad for some frames, states are told apart by
+ * chip8_state_hash so each is expanded once. found targets and stuck
+ * states come out as json lines with the shortest input that gets there,
+ * then a summary with how much of the rom ran */
+
+static const char usage[] =
+    "usage: sheep8-explore [options] rom\n"
+    "  -f frames     frames each keypad is held for, 6 by default\n"
+    "  -a keys       keypads to try as comma separated masks, bit k for key\n"
+    "                k. nothing and every single key by default\n"
+    "  -A            try all 65536 keypads\n"
+    "  -d depth      stop after this many steps, 30 by default\n"
+    "  -n states     stop after this many distinct states, 200000 by default\n"
+    "  -p addr       target: the instruction at addr runs\n"
+    "  -m addr=val   target: the byte at addr reads val after a step\n"
+    "  -H hash       target: the screen hash matches after a step\n"
+    "  -1            stop at the first target found\n"
+    "  -c file       write the rom ranges that never ran to file\n"
+    "  -k clock      clock speed in hz, 1 to 1000000\n"
+    "  -r seed       random seed\n"
+    "  -j threads    threads to search with, 0 for one per core, at most 256\n"
+    "a state where no keypad changes anything but the keys is reported as\n"
+    "stuck, halts and softlocks look like that\n";
+
+#define EXPLORE_NONE UINT32_MAX
+
+/* what a child hit, bits of explore_child.found */
+enum {
+    found_pc = 1,
+    found_mem = 2,
+    found_hash = 4,
+    found_any = found_pc | found_mem | found_hash,
+    unchanged = 8, /* the step only changed the keys, and no key is awaited */
+};
+
+static const char *found_names[] = { "pc", "mem", "hash" };
+
+typedef struct {
+    uint64_t frames, depth, states, seed;
+    int clockspeed;
+    uint64_t pc, mem_addr, mem_val, hash;
+    bool has_pc, has_mem, has_hash, first;
+    uint16_t *actions;
+    size_t nactions;
+} explore_opts;
+
+/* a distinct state, kept for walking back the inputs that reached it */
+typedef struct {
+    uint32_t parent;
+    uint16_t keys;
+} explore_node;
+
+typedef struct {
+    chip8_cow *cow; /* NULL when it was known already, or failed */
+    uint64_t hash;
+    uint8_t found;
+    bool failed; /* ran out of memory forking or running it */
+} explore_child;
+
+/* open addressing set of state hashes, 0 marks a free slot */
+typedef struct {
+    uint64_t *slots;
+    size_t cap, len;
+} explore_set;
+
+static uint64_t set_key(uint64_t hash) {
+    return hash != 0 ? hash : 1;
+}
+
+static bool set_has(const explore_set *set, uint64_t hash) {
+    uint64_t key = set_key(hash);
+    for (size_t at = key & (set->cap - 1);; at = (at + 1) & (set->cap - 1)) {
+        if (set->slots[at] == key)
+            return true;
+        if (set->slots[at] == 0)
+            return false;
+    }
+}
+
+/* false if it was there already */
+static bool set_add(explore_set *set, uint64_t hash) {
+    if ((set->len + 1) * 2 > set->cap) {
+        explore_set grown = { .cap = set->cap ? set->cap * 2 : 1024 };
+        grown.slots = calloc(grown.cap, sizeof *grown.slots);
+        if (grown.slots == NULL)
+            panic("Out of memory growing the state set");
+        for (size_t at = 0; at < set->cap; at++)
+            if (set->slots[at] != 0)
+                set_add(&grown, set->slots[at]);
+        free(set->slots);
+        *set = grown;
+    }
+    uint64_t key = set_key(hash);
+    size_t at = key & (set->cap - 1);
+    for (; set->slots[at] != 0; at = (at + 1) & (set->cap - 1))
+        if (set->slots[at] == key)
+            return false;
+    set->slots[at] = key;
+    set->len++;
+    return true;
+}
+
+/* one level of the search, expanded in parallel */
+typedef struct {
+    const explore_opts *opts;
+    const explore_set *seen;
+    chip8_cow **frontier;
+    explore_child *children; /* nactions per frontier state */
+    uint32_t **cover; /* per worker, the stamp of the last step each address ran in */
+    uint32_t *stamps;
+} explore_level;
+
+static void explore_task(void *ctx, size_t i, int worker) {
+    explore_level *level = ctx;
+    const explore_opts *opts = level->opts;
+    uint32_t *cover = level->cover[worker];
+    for (size_t a = 0; a < opts->nactions; a++) {
+        explore_child *child = &level->children[i * opts->nactions + a];
+        chip8_cow *cow = chip8_cow_fork(level->frontier[i]);
+        child->found = 0;
+        child->failed = cow == NULL;
+        if (cow != NULL)
+            chip8_cow_keys(cow, opts->actions[a]);
+        uint64_t before = cow != NULL ? chip8_cow_state_hash(cow) : 0;
+        uint32_t stamp = ++level->stamps[worker];
+        for (uint64_t f = 0; f < opts->frames && !child->failed; f++)
+            child->failed = !chip8_cow_interpret_cover(cow, cover, stamp);
+        if (child->failed) {
+            chip8_cow_free(cow);
+            child->cow = NULL;
+            child->hash = 0;
+            continue;
+        }
+        child->hash = chip8_cow_state_hash(cow);
+        /* a key wait always ends on the release after some press */
+        if (child->hash == before && !cow->key_waiting)
+            child->found |= unchanged;
+        if (opts->has_pc && cover[opts->pc] == stamp)
+            child->found |= found_pc;
+        if (opts->has_mem && chip8_cow_peek(cow, opts->mem_addr) == opts->mem_val)
+            child->found |= found_mem;
+        if (opts->has_hash && cow->screen_hash == opts->hash)
+            child->found |= found_hash;
+        /* duplicates across the level are sorted out in order afterwards */
+        if (set_has(level->seen, child->hash)) {
+            chip8_cow_free(cow);
+            cow = NULL;
+        }
+        child->cow = cow;
+    }
+}
+
+static bool parse_actions(const char *s, explore_opts *opts) {
+    size_t count = 1;
+    for (const char *c = s; *c; c++)
+        count += *c == ',';
+    free(opts->actions);
+    opts->actions = calloc(count, sizeof *opts->actions);
+    if (opts->actions == NULL)
+        panic("Out of memory");
+    opts->nactions = 0;
+    while (*s) {
+        char *end;
+        unsigned long keys = strtoul(s, &end, 0);
+        if (end == s || keys > 0xFFFF || (*end != ',' && *end != '\0'))
+            return false;
+        opts->actions[opts->nactions++] = keys;
+        s = *end == ',' ? end + 1 : end;
+    }
+    return opts->nactions > 0;
+}
+
+/* the keypads from the root to node, as a json array */
+static void print_inputs(const explore_node *nodes, uint32_t node) {
+    size_t depth = 0;
+    for (uint32_t n = node; nodes[n].parent != EXPLORE_NONE; n = nodes[n].parent)
+        depth++;
+    uint16_t *keys = malloc((depth + 1) * sizeof *keys);
+    if (keys == NULL)
+        panic("Out of memory");
+    size_t d = depth;
+    for (uint32_t n = node; nodes[n].parent != EXPLORE_NONE; n = nodes[n].parent)
+        keys[--d] = nodes[n].keys;
+    printf("[");
+    for (d = 0; d < depth; d++)
+        printf("%s\"0x%04x\"", d ? ", " : "", keys[d]);
+    printf("]");
+    free(keys);
+}
+
+static void report(const char *what, const explore_opts *opts, const explore_node *nodes,
+        uint32_t node, uint64_t depth, uint64_t hash) {
+    printf("{\"found\": \"%s\", \"depth\": %llu, \"frames\": %llu, \"state_hash\": "
+            "\"0x%016llx\", \"inputs\": ", what, (unsigned long long)depth,
+            (unsigned long long)(depth * opts->frames), (unsigned long long)hash);
+    print_inputs(nodes, node);
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* rom addresses that never ran, as ranges a line */
+static bool write_uncovered(const char *path, const uint8_t *covered, uint32_t rom_size) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        warnerr("Failed to open %s", path);
+        return false;
+    }
+    uint32_t end = 0x200 + rom_size;
+    for (uint32_t addr = 0x200; addr < end; addr++) {
+        if (covered[addr])
+            continue;
+        uint32_t from = addr;
+        while (addr + 1 < end && !covered[addr + 1])
+            addr++;
+        fprintf(f, "0x%03x-0x%03x\n", from, addr);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    explore_opts opts = { .frames = 6, .depth = 30, .states = 200000, .seed = DEFAULT_SEED };
+    const char *rom = NULL, *cover_path = NULL;
+    uint64_t threads = 1;
+    bool all_keys = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-' || arg[1] == '\0') {
+            if (rom != NULL) {
+                fputs(usage, stderr);
+                return 1;
+            }
+            rom = arg;
+            continue;
+        }
+        if (strcmp(arg, "-A") == 0 || strcmp(arg, "-1") == 0) {
+            all_keys |= arg[1] == 'A';
+            opts.first |= arg[1] == '1';
+            continue;
+        }
+        if (strchr("fadnpmHckrj", arg[1]) == NULL || arg[2] != '\0' || i + 1 >= argc) {
+            fputs(usage, stderr);
+            return 1;
+        }
+        const char *val = argv[++i];
+        bool ok = true;
+        const char *eq;
+        switch (arg[1]) {
+            case 'f': ok = cli_parse_u64(val, &opts.frames) && opts.frames > 0; break;
+            case 'a': ok = parse_actions(val, &opts); break;
+            case 'd': ok = cli_parse_u64(val, &opts.depth); break;
+            case 'n': ok = cli_parse_u64(val, &opts.states) && opts.states < EXPLORE_NONE; break;
+            case 'p': ok = opts.has_pc = cli_parse_u64(val, &opts.pc) && opts.pc < MEMORY_SIZE; break;
+            case 'm': {
+                char addr[32];
+                eq = strchr(val, '=');
+                ok = eq != NULL && (size_t)(eq - val) < sizeof addr;
+                if (ok) {
+                    memcpy(addr, val, eq - val);
+                    addr[eq - val] = '\0';
+                    ok = opts.has_mem = cli_parse_range(addr, 0, MEMORY_SIZE - 1, &opts.mem_addr)
+                        && cli_parse_range(eq + 1, 0, 0xFF, &opts.mem_val);
+                }
+                break;
+            }
+            case 'H': ok = opts.has_hash = cli_parse_u64(val, &opts.hash); break;
+            case 'c': cover_path = val; break;
+            case 'k': ok = cli_parse_clock(val, &opts.clockspeed); break;
+            case 'r': ok = cli_parse_u64(val, &opts.seed); break;
+            case 'j': ok = cli_parse_range(val, 0, POOL_MAX_THREADS, &threads); break;
+        }
+        if (!ok) {
+            warn("Bad value for %s: %s", arg, val);
+            fputs(usage, stderr);
+            return 1;
+        }
+    }
+    if (rom == NULL) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    if (all_keys || opts.actions == NULL) {
+        free(opts.actions);
+        opts.nactions = all_keys ? 0x10000 : 17;
+        opts.actions = calloc(opts.nactions, sizeof *opts.actions);
+        if (opts.actions == NULL)
+            panic("Out of memory");
+        for (size_t a = 0; a < opts.nactions; a++)
+            opts.actions[a] = all_keys ? a : a == 0 ? 0 : 1u << (a - 1);
+    }
+
+    chip8 *chip = malloc(sizeof *chip);
+    if (chip == NULL)
+        panic("Out of memory");
+    chip8_init(chip);
+    chip8_seed(chip, opts.seed);
+    if (opts.clockspeed > 0)
+        chip->clockspeed = opts.clockspeed;
+    if (chip8_load_rom_from_file(chip, rom) < 0)
+        return 1;
+    uint32_t rom_size = chip->rom_size;
+
+    pool_t *pool = threads != 1 ? pool_new((int)threads) : NULL;
+    int nworkers = pool_threads(pool);
+    explore_level level = { .opts = &opts };
+    level.cover = calloc(nworkers, sizeof *level.cover);
+    level.stamps = calloc(nworkers, sizeof *level.stamps);
+    if (level.cover == NULL || level.stamps == NULL)
+        panic("Out of memory");
+    for (int w = 0; w < nworkers; w++)
+        if ((level.cover[w] = calloc(MEMORY_SIZE, sizeof **level.cover)) == NULL)
+            panic("Out of memory");
+
+    explore_set seen = { 0 }, stuck_seen = { 0 };
+    size_t nodes_cap = 1024, nnodes = 0;
+    explore_node *nodes = malloc(nodes_cap * sizeof *nodes);
+    chip8_cow **frontier = malloc(sizeof *frontier);
+    uint32_t *frontier_ids = malloc(sizeof *frontier_ids);
+    if (nodes == NULL || frontier == NULL || frontier_ids == NULL)
+        panic("Out of memory");
+    if ((frontier[0] = chip8_fork(chip)) == NULL)
+        return 1;
+    free(chip);
+    set_add(&seen, chip8_cow_state_hash(frontier[0]));
+    nodes[nnodes++] = (explore_node){ .parent = EXPLORE_NONE };
+    frontier_ids[0] = 0;
+    size_t nfrontier = 1;
+
+    uint8_t reported = 0;
+    uint64_t stuck = 0, depth = 0, expanded = 0;
+    const char *stop = "exhausted";
+    int status = 0;
+    double start = cli_now();
+    while (nfrontier > 0) {
+        if (depth >= opts.depth) {
+            stop = "depth";
+            break;
+        }
+        level.seen = &seen;
+        level.frontier = frontier;
+        level.children = malloc(nfrontier * opts.nactions * sizeof *level.children);
+        if (level.children == NULL)
+            panic("Out of memory expanding %zu states", nfrontier);
+        pool_run(pool, nfrontier, 4, explore_task, &level);
+        expanded += nfrontier;
+        depth++;
+
+        /* in order, so the outcome is the same for any thread count */
+        size_t next_cap = 0, nnext = 0;
+        chip8_cow **next = NULL;
+        uint32_t *next_ids = NULL;
+        bool full = false, failed = false;
+        for (size_t i = 0; i < nfrontier; i++) {
+            explore_child *children = &level.children[i * opts.nactions];
+            bool all_unchanged = true;
+            for (size_t a = 0; a < opts.nactions; a++) {
+                explore_child *child = &children[a];
+                all_unchanged &= (child->found & unchanged) != 0;
+                failed |= child->failed;
+                if (child->cow == NULL)
+                    continue;
+                if (full || !set_add(&seen, child->hash)) {
+                    chip8_cow_free(child->cow);
+                    continue;
+                }
+                if (nnodes == nodes_cap) {
+                    nodes_cap *= 2;
+                    if ((nodes = realloc(nodes, nodes_cap * sizeof *nodes)) == NULL)
+                        panic("Out of memory");
+                }
+                uint32_t id = nnodes++;
+                nodes[id] = (explore_node){ .parent = frontier_ids[i], .keys = opts.actions[a] };
+                for (int bit = 0; bit < 3; bit++) {
+                    if ((child->found & 1 << bit) && !(reported & 1 << bit)) {
+                        reported |= 1 << bit;
+                        report(found_names[bit], &opts, nodes, id, depth, child->hash);
+                    }
+                }
+                if (nnext == next_cap) {
+                    next_cap = next_cap ? next_cap * 2 : 256;
+                    next = realloc(next, next_cap * sizeof *next);
+                    next_ids = realloc(next_ids, next_cap * sizeof *next_ids);
+                    if (next == NULL || next_ids == NULL)
+                        panic("Out of memory");
+                }
+                next[nnext] = child->cow;
+                next_ids[nnext++] = id;
+                full = nnodes >= opts.states;
+            }
+            /* the same stuck machine shows up once per keypad held into it,
+             * told apart by what the first keypad turns it into */
+            if (all_unchanged && set_add(&stuck_seen, children[0].hash) && stuck++ < 10)
+                report("stuck", &opts, nodes, frontier_ids[i], depth - 1,
+                        chip8_cow_state_hash(frontier[i]));
+        }
+        free(level.children);
+        for (size_t i = 0; i < nfrontier; i++)
+            chip8_cow_free(frontier[i]);
+        free(frontier);
+        free(frontier_ids);
+        frontier = next;
+        frontier_ids = next_ids;
+        nfrontier = nnext;
+
+        if (failed) {
+            warn("Out of memory running the states of depth %llu", (unsigned long long)depth);
+            stop = "memory";
+            status = 1;
+            break;
+        }
+        uint8_t wanted = (opts.has_pc ? found_pc : 0) | (opts.has_mem ? found_mem : 0)
+            | (opts.has_hash ? found_hash : 0);
+        if (opts.first && (reported & found_any)) {
+            stop = "found";
+            break;
+        }
+        if (wanted != 0 && (reported & wanted) == wanted) {
+            stop = "found";
+            break;
+        }
+        if (full) {
+            stop = "states";
+            break;
+        }
+    }
+    double seconds = cli_now() - start;
+
+    /* an instruction that ran covers both its bytes */
+    uint8_t *covered = calloc(MEMORY_SIZE + 1, 1);
+    if (covered == NULL)
+        panic("Out of memory");
+    for (int w = 0; w < nworkers; w++) {
+        for (uint32_t addr = 0; addr < MEMORY_SIZE; addr++) {
+            if (level.cover[w][addr] != 0)
+                covered[addr] = covered[addr + 1] = 1;
+        }
+    }
+    uint32_t ran = 0;
+    for (uint32_t addr = 0x200; addr < 0x200 + rom_size; addr++)
+        ran += covered[addr];
+
+    printf("{\"rom\": ");
+    cli_json_string(rom);
+    printf(", \"stop\": \"%s\", \"depth\": %llu, \"states\": %zu, "
+            "\"expanded\": %llu, \"stuck\": %llu, \"seconds\": %.6f, \"states_per_second\": %.0f, "
+            "\"rom_bytes\": %u, \"rom_bytes_run\": %u, \"coverage\": %.4f}\n",
+            stop, (unsigned long long)depth, nnodes, (unsigned long long)expanded,
+            (unsigned long long)stuck, seconds, seconds > 0 ? nnodes / seconds : 0.0,
+            rom_size, ran, rom_size ? (double)ran / rom_size : 0.0);
+    if (cover_path != NULL && !write_uncovered(cover_path, covered, rom_size))
+        status = 1;
+
+    for (size_t i = 0; i < nfrontier; i++)
+        chip8_cow_free(frontier[i]);
+    free(frontier);
+    free(frontier_ids);
+    free(covered);
+    for (int w = 0; w < nworkers; w++)
+        free(level.cover[w]);
+    free(level.cover);
+    free(level.stamps);
+    free(seen.slots);
+    free(stuck_seen.slots);
+    free(nodes);
+    free(opts.actions);
+    pool_free(pool);
+    return status;
+}
@@ -0,0 +1,346 @@
+#define _POSIX_C_SOURCE 200809L
+#include "sheep8.h"
+#include "log.h"
+#include "cli.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* sheep8-headless, runs roms without a window as fast as they go and
+ * reports what happened as json on stdout */
+
+static const char usage[] =
+    "usage: sheep8-headless [options] rom...\n"
+    "  -f frames     stop after this many frames\n"
+    "  -c cycles     stop after this many cycles\n"
+    "  -p addr       stop when pc reaches addr\n"
+    "  -H hash       stop when the screen hash (screen_hash in the output) matches\n"
+    "  -x            stop when the program halts on opcode 0000\n"
+    "  -m movie      take input from a movie, stops when it ends. repeat to\n"
+    "                replay several movies of one rom\n"
+    "  -s script     take input from a script, lines of: frame key down|up\n"
+    "  -k clock      clock speed in hz, 1 to 1000000\n"
+    "  -r seed       random seed\n"
+    "  -d file       dump the final screen to file as pbm\n"
+    "  -D every      with -d, also dump every this many frames to file.N\n"
+    "  -S name       publish every frame to the posix shared memory segment\n"
+    "                name, see publish.h\n"
+    "  -j threads    run several roms or movies on this many threads, 0 for\n"
+    "                one per core, at most 256\n"
+    "without -f, -c or -m it stops after 3600 frames. with several roms or\n"
+    "movies there is a json line for each, in order, and dumps and segments\n"
+    "go to file.J and name.J\n";
+
+typedef struct {
+    uint64_t frame;
+    uint8_t key;
+    bool down;
+} script_event;
+
+typedef struct {
+    script_event *events;
+    size_t len, cap, pos;
+} script_t;
+
+static int script_load(script_t *script, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        warnerr("Failed to open script %s", path);
+        return -1;
+    }
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof line, fp) != NULL) {
+        unsigned long long frame;
+        unsigned key;
+        char action[8];
+        lineno++;
+        if (line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+        if (sscanf(line, "%llu %x %7s", &frame, &key, action) != 3 || key > 0xF
+                || (strcmp(action, "down") != 0 && strcmp(action, "up") != 0)) {
+            warn("%s:%d: expected: frame key down|up", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+        if (script->len > 0 && frame < script->events[script->len - 1].frame) {
+            warn("%s:%d: frames must not go backwards", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+        if (script->len == script->cap) {
+            size_t cap = script->cap ? script->cap * 2 : 64;
+            script_event *events = realloc(script->events, cap * sizeof *events);
+            if (events == NULL) {
+                warn("Out of memory reading script");
+                fclose(fp);
+                return -1;
+            }
+            script->events = events;
+            script->cap = cap;
+        }
+        script->events[script->len++] = (script_event){
+            .frame = frame, .key = key, .down = action[0] == 'd' };
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* queue the script events of the frame chip is about to run */
+static void script_play_frame(script_t *script, chip8 *chip, uint64_t frame) {
+    while (script->pos < script->len && script->events[script->pos].frame <= frame) {
+        script_event *e = &script->events[script->pos];
+        chip8_input_event ev = { .cycle = chip->cycle, .key = e->key, .down = e->down };
+        if (!chip8_input_push(chip, ev))
+            break;
+        script->pos++;
+    }
+}
+
+static int dump_screen(const chip8 *chip, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        warnerr("Failed to open %s", path);
+        return -1;
+    }
+    fprintf(fp, "P1\n%d %d\n", WIDTH, HEIGHT);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++)
+            fputc(chip->screen[y][x] ? '1' : '0', fp);
+        fputc('\n', fp);
+    }
+    return fclose(fp);
+}
+
+static bool halted(const chip8 *chip) {
+    return !chip->key_waiting && chip->pc + 1 < MEMORY_SIZE
+        && chip->memory[chip->pc] == 0 && chip->memory[chip->pc + 1] == 0;
+}
+
+typedef struct {
+    uint64_t max_frames, max_cycles, stop_pc, stop_hash;
+    uint64_t seed, dump_every;
+    int clockspeed;
+    bool has_pc, has_hash, stop_halt;
+    const char *script_path;
+} headless_opts;
+
+/* one rom run, or one movie replayed against a rom */
+typedef struct {
+    const char *rom, *movie, *dump, *share;
+    bool ok;
+    const char *stop;
+    uint64_t frames;
+    double seconds;
+    chip8 chip;
+} headless_job;
+
+static void headless_run(const headless_opts *opts, headless_job *job) {
+    chip8 *chip = &job->chip;
+    movie_t movie;
+    script_t script = { 0 };
+    publish_t pub = { 0 };
+    chip8_init(chip);
+    chip8_seed(chip, opts->seed);
+    if (opts->clockspeed > 0)
+        chip->clockspeed = opts->clockspeed;
+    if (chip8_load_rom_from_file(chip, job->rom) < 0)
+        return;
+    movie_init(&movie);
+    bool playing = false;
+    if (job->movie != NULL) {
+        if (movie_load(&movie, job->movie) < 0)
+            goto out;
+        if (!movie_matches(&movie, chip)) {
+            warn("Movie %s was recorded with a different rom", job->movie);
+            goto out;
+        }
+        movie_play(&movie, chip);
+        playing = true;
+    }
+    if (opts->script_path != NULL && script_load(&script, opts->script_path) < 0)
+        goto out;
+    if (job->share != NULL && !publish_open(&pub, job->share))
+        goto out;
+
+    const char *stop = "frames";
+    uint64_t frames = 0;
+    double start = cli_now();
+    for (;;) {
+        if (!chip->in_frame) {
+            if (opts->max_frames > 0 && frames >= opts->max_frames)
+                break;
+            if (job->movie != NULL && !playing) {
+                stop = "movie";
+                break;
+            }
+            if (playing)
+                playing = movie_play_frame(&movie, chip);
+            script_play_frame(&script, chip, frames);
+        }
+        if (opts->max_cycles > 0 && chip->cycle >= opts->max_cycles) {
+            stop = "cycles";
+            break;
+        }
+        if (opts->stop_halt && halted(chip)) {
+            stop = "halt";
+            break;
+        }
+        if (chip8_step(chip)) {
+            frames++;
+            publish_frame(&pub, chip);
+            if (job->dump != NULL && opts->dump_every > 0 && frames % opts->dump_every == 0) {
+                char path[4096];
+                snprintf(path, sizeof path, "%s.%llu", job->dump, (unsigned long long)frames);
+                dump_screen(chip, path);
+            }
+        }
+        if (opts->has_hash && chip->screen_hash == opts->stop_hash) {
+            stop = "hash";
+            break;
+        }
+        if (opts->has_pc && chip->pc == opts->stop_pc) {
+            stop = "pc";
+            break;
+        }
+    }
+    job->seconds = cli_now() - start;
+    job->stop = stop;
+    job->frames = frames;
+    job->ok = true;
+    if (job->dump != NULL)
+        dump_screen(chip, job->dump);
+out:
+    publish_close(&pub);
+    movie_clean(&movie);
+    free(script.events);
+}
+
+typedef struct {
+    const headless_opts *opts;
+    headless_job *jobs;
+} headless_batch;
+
+static void headless_task(void *ctx, size_t i, int worker) {
+    headless_batch *batch = ctx;
+    (void)worker;
+    headless_run(batch->opts, &batch->jobs[i]);
+}
+
+static void headless_report(const headless_job *job) {
+    const chip8 *chip = &job->chip;
+    printf("{\"rom\": ");
+    cli_json_string(job->rom);
+    if (job->movie != NULL) {
+        printf(", \"movie\": ");
+        cli_json_string(job->movie);
+    }
+    if (!job->ok) {
+        printf(", \"stop\": \"error\"}\n");
+        return;
+    }
+    printf(", \"stop\": \"%s\", \"frames\": %llu, \"cycles\": %llu, "
+            "\"instructions\": %llu, \"seconds\": %.6f, \"mips\": %.3f, \"pc\": %u, "
+            "\"state_hash\": \"0x%016llx\", \"screen_hash\": \"0x%016llx\"}\n",
+            job->stop, (unsigned long long)job->frames, (unsigned long long)chip->cycle,
+            (unsigned long long)chip->instret, job->seconds,
+            job->seconds > 0 ? chip->instret / job->seconds / 1e6 : 0.0, chip->pc,
+            (unsigned long long)chip8_state_hash(chip),
+            (unsigned long long)chip->screen_hash);
+}
+
+int main(int argc, char **argv) {
+    headless_opts opts = { .seed = DEFAULT_SEED };
+    const char *dump = NULL, *share = NULL;
+    uint64_t threads = 1;
+    const char **roms = calloc(argc, sizeof *roms);
+    const char **movies = calloc(argc, sizeof *movies);
+    int nroms = 0, nmovies = 0;
+    if (roms == NULL || movies == NULL)
+        panic("Out of memory");
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-' || arg[1] == '\0') {
+            roms[nroms++] = arg;
+            continue;
+        }
+        if (strcmp(arg, "-x") == 0) {
+            opts.stop_halt = true;
+            continue;
+        }
+        if (strchr("fcpHmskrdDSj", arg[1]) == NULL || arg[2] != '\0' || i + 1 >= argc) {
+            fputs(usage, stderr);
+            return 1;
+        }
+        const char *val = argv[++i];
+        bool ok = true;
+        switch (arg[1]) {
+            case 'f': ok = cli_parse_u64(val, &opts.max_frames); break;
+            case 'c': ok = cli_parse_u64(val, &opts.max_cycles); break;
+            case 'p': ok = opts.has_pc = cli_parse_u64(val, &opts.stop_pc); break;
+            case 'H': ok = opts.has_hash = cli_parse_u64(val, &opts.stop_hash); break;
+            case 'm': movies[nmovies++] = val; break;
+            case 's': opts.script_path = val; break;
+            case 'k': ok = cli_parse_clock(val, &opts.clockspeed); break;
+            case 'r': ok = cli_parse_u64(val, &opts.seed); break;
+            case 'd': dump = val; break;
+            case 'D': ok = cli_parse_u64(val, &opts.dump_every); break;
+            case 'S': share = val; break;
+            case 'j': ok = cli_parse_range(val, 0, POOL_MAX_THREADS, &threads); break;
+        }
+        if (!ok) {
+            warn("Bad number for %s: %s", arg, val);
+            return 1;
+        }
+    }
+    if (nroms == 0 || (nroms > 1 && nmovies > 1)) {
+        fputs(usage, stderr);
+        return 1;
+    }
+    if (opts.max_frames == 0 && opts.max_cycles == 0 && nmovies == 0)
+        opts.max_frames = 3600;
+
+    /* several roms run side by side, or several movies of one rom */
+    int njobs = nroms > nmovies ? nroms : nmovies;
+    headless_job *jobs = calloc(njobs, sizeof *jobs);
+    char (*dumps)[4096] = calloc(njobs, sizeof *dumps);
+    char (*shares)[64] = calloc(njobs, sizeof *shares);
+    if (jobs == NULL || dumps == NULL || shares == NULL)
+        panic("Out of memory");
+    for (int j = 0; j < njobs; j++) {
+        jobs[j].rom = roms[nroms > 1 ? j : 0];
+        jobs[j].movie = nmovies > 0 ? movies[nmovies > 1 ? j : 0] : NULL;
+        if (dump != NULL && njobs > 1) {
+            snprintf(dumps[j], sizeof dumps[j], "%s.%d", dump, j);
+            jobs[j].dump = dumps[j];
+        } else {
+            jobs[j].dump = dump;
+        }
+        if (share != NULL && njobs > 1) {
+            snprintf(shares[j], sizeof shares[j], "%s.%d", share, j);
+            jobs[j].share = shares[j];
+        } else {
+            jobs[j].share = share;
+        }
+    }
+
+    pool_t *pool = njobs > 1 && threads != 1 ? pool_new((int)threads) : NULL;
+    headless_batch batch = { .opts = &opts, .jobs = jobs };
+    pool_run(pool, njobs, 1, headless_task, &batch);
+    pool_free(pool);
+
+    int status = 0;
+    for (int j = 0; j < njobs; j++) {
+        headless_report(&jobs[j]);
+        if (!jobs[j].ok)
+            status = 1;
+    }
+    free(jobs);
+    free(dumps);
+    free(shares);
+    free(roms);
+    free(movies);
+    return status;
+}
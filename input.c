@@ -9,7 +9,27 @@ static const int kb2pad[] = {
     /**** TO AVOID 0x0 COLLISION, EVERY VALUE HERE HAS BEEN OFFSET BY +1 */
 };
 
-void chip8_input_handle(chip8 *chip, SDL_Event e) {
+void chip8_input_queue_key(chip8 *chip, uint64_t cycle, int key, bool down) {
+    chip8_input_event ev = { .cycle = cycle, .key = key, .down = down };
+    if (chip8_input_push(chip, ev))
+        return;
+    /* queue full, better late than a stuck key */
+    chip8_input_force(chip, ev);
+}
+
+static uint64_t timestamp_to_cycle(chip8 *chip, uint32_t ts, uint64_t since, uint64_t now) {
+    int budget = chip->clockspeed / 60;
+    int64_t elapsed = (int64_t)ts - (int64_t)(uint32_t)since;
+    int64_t span = now - since;
+    if (budget <= 0 || elapsed <= 0 || span <= 0)
+        return chip->cycle;
+    int64_t offset = elapsed * budget / span;
+    if (offset >= budget)
+        offset = budget - 1;
+    return chip->cycle + offset;
+}
+
+void chip8_input_handle(chip8 *chip, SDL_Event e, uint64_t since, uint64_t now) {
     switch (e.type) {
         case SDL_KEYDOWN: /* FALLTHROUGH */
         case SDL_KEYUP:
@@ -18,10 +38,10 @@ void chip8_input_handle(chip8 *chip, SDL_Event e) {
             int pad = kb2pad[e.key.keysym.sym] - 1;
             if (pad == -1)
                 return;
-            if (e.type == SDL_KEYDOWN)
-                chip8_keydown(chip, pad);
-            else
-                chip8_keyup(chip, pad);
+            if (e.key.repeat)
+                return;
+            chip8_input_queue_key(chip, timestamp_to_cycle(chip, e.key.timestamp, since, now),
+                    pad, e.type == SDL_KEYDOWN);
     }
 }
 
@@ -19,7 +19,10 @@ static const struct {
     "C", 0xB, "V", 0xF,
 };
 
-void chip8_input_handle(chip8 *chip, SDL_Event e);
+/* queue key events of e at the cycle matching its timestamp, the frame about
+ * to run covers the ticks between the previous poll (since) and now */
+void chip8_input_handle(chip8 *chip, SDL_Event e, uint64_t since, uint64_t now);
+void chip8_input_queue_key(chip8 *chip, uint64_t cycle, int key, bool down);
 
 #endif /* INPUT_H_ */
 
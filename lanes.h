@@ -0,0 +1,137 @@
+/* sixteen uint8_t lanes, one per instance of a chip8_batch lockstep
+ * group, not part of the api. sse2 where the compiler has it, the same
+ * thing one byte at a time everywhere else. masks come in two forms, a
+ * lanes_t of 0xff / 0x00 bytes and a uint32_t with bit j for lane j */
+#ifndef LANES_H_
+#define LANES_H_
+
+#include <stdint.h>
+#include "batch.h"
+
+#if defined(__SSE2__) && !defined(__TINYC__)
+#include <emmintrin.h>
+
+#define LANES_SIMD 1
+
+typedef __m128i lanes_t;
+
+static inline lanes_t lanes_load(const void *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void lanes_store(void *p, lanes_t a) { _mm_storeu_si128((__m128i *)p, a); }
+static inline lanes_t lanes_splat(uint8_t x) { return _mm_set1_epi8((char)x); }
+static inline lanes_t lanes_add(lanes_t a, lanes_t b) { return _mm_add_epi8(a, b); }
+static inline lanes_t lanes_sub(lanes_t a, lanes_t b) { return _mm_sub_epi8(a, b); }
+static inline lanes_t lanes_subs(lanes_t a, lanes_t b) { return _mm_subs_epu8(a, b); }
+static inline lanes_t lanes_max(lanes_t a, lanes_t b) { return _mm_max_epu8(a, b); }
+static inline lanes_t lanes_and(lanes_t a, lanes_t b) { return _mm_and_si128(a, b); }
+static inline lanes_t lanes_or(lanes_t a, lanes_t b) { return _mm_or_si128(a, b); }
+static inline lanes_t lanes_xor(lanes_t a, lanes_t b) { return _mm_xor_si128(a, b); }
+static inline lanes_t lanes_eq(lanes_t a, lanes_t b) { return _mm_cmpeq_epi8(a, b); }
+static inline lanes_t lanes_shr1(lanes_t a) {
+    return _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7F));
+}
+static inline uint32_t lanes_bits(lanes_t m) { return (uint32_t)_mm_movemask_epi8(m); }
+
+/* b where m is set, a elsewhere */
+static inline lanes_t lanes_select(lanes_t m, lanes_t a, lanes_t b) {
+    return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+}
+
+/* bit j of each byte j, then compared into whole bytes */
+static inline lanes_t lanes_from_bits(uint32_t bits) {
+    const uint64_t spread = 0x0101010101010101ULL, pick = 0x8040201008040201ULL;
+    lanes_t v = _mm_set_epi64x((long long)(((bits >> 8 & 0xFF) * spread) & pick),
+            (long long)(((bits & 0xFF) * spread) & pick));
+    return _mm_xor_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), _mm_set1_epi8(-1));
+}
+
+/* lanes whose uint16_t at p equals x */
+static inline uint32_t lanes_match16(const uint16_t *p, uint16_t x) {
+    __m128i want = _mm_set1_epi16((short)x);
+    __m128i lo = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)p), want);
+    __m128i hi = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(p + 8)), want);
+    return (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+}
+
+#else
+
+#define LANES_SIMD 0
+
+typedef struct {
+    uint8_t b[CHIP8_LANES];
+} lanes_t;
+
+#define LANES_MAP(expr) \
+    lanes_t r; \
+    for (int j = 0; j < CHIP8_LANES; j++) \
+        r.b[j] = (uint8_t)(expr); \
+    return r
+
+static inline lanes_t lanes_load(const void *p) {
+    lanes_t r;
+    const uint8_t *s = p;
+    for (int j = 0; j < CHIP8_LANES; j++)
+        r.b[j] = s[j];
+    return r;
+}
+
+static inline void lanes_store(void *p, lanes_t a) {
+    uint8_t *d = p;
+    for (int j = 0; j < CHIP8_LANES; j++)
+        d[j] = a.b[j];
+}
+
+static inline lanes_t lanes_splat(uint8_t x) { LANES_MAP(x); }
+static inline lanes_t lanes_add(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] + b.b[j]); }
+static inline lanes_t lanes_sub(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] - b.b[j]); }
+static inline lanes_t lanes_subs(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] > b.b[j] ? a.b[j] - b.b[j] : 0); }
+static inline lanes_t lanes_max(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] > b.b[j] ? a.b[j] : b.b[j]); }
+static inline lanes_t lanes_and(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] & b.b[j]); }
+static inline lanes_t lanes_or(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] | b.b[j]); }
+static inline lanes_t lanes_xor(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] ^ b.b[j]); }
+static inline lanes_t lanes_eq(lanes_t a, lanes_t b) { LANES_MAP(a.b[j] == b.b[j] ? 0xFF : 0); }
+static inline lanes_t lanes_shr1(lanes_t a) { LANES_MAP(a.b[j] >> 1); }
+static inline lanes_t lanes_select(lanes_t m, lanes_t a, lanes_t b) { LANES_MAP(m.b[j] ? b.b[j] : a.b[j]); }
+static inline lanes_t lanes_from_bits(uint32_t bits) { LANES_MAP(bits >> j & 1 ? 0xFF : 0); }
+
+static inline uint32_t lanes_bits(lanes_t m) {
+    uint32_t bits = 0;
+    for (int j = 0; j < CHIP8_LANES; j++)
+        bits |= (uint32_t)(m.b[j] >> 7) << j;
+    return bits;
+}
+
+static inline uint32_t lanes_match16(const uint16_t *p, uint16_t x) {
+    uint32_t bits = 0;
+    for (int j = 0; j < CHIP8_LANES; j++)
+        bits |= (uint32_t)(p[j] == x) << j;
+    return bits;
+}
+
+#undef LANES_MAP
+
+#endif
+
+/* index of the lowest set bit, bits must not be zero */
+static inline int lanes_first(uint32_t bits) {
+#if defined(__GNUC__) && !defined(__TINYC__)
+    return __builtin_ctz(bits);
+#else
+    int j = 0;
+    while (!(bits >> j & 1))
+        j++;
+    return j;
+#endif
+}
+
+static inline int lanes_count(uint32_t bits) {
+#if defined(__GNUC__) && !defined(__TINYC__)
+    return __builtin_popcount(bits);
+#else
+    int n = 0;
+    for (; bits; bits &= bits - 1)
+        n++;
+    return n;
+#endif
+}
+
+#endif /* LANES_H_ */
@@ -79,6 +79,11 @@
  */
 #define unreachable(...) __stderr_log("UNREACHABLE", __FL__, __VA_ARGS__);
 
+/* libsheep8 logs through this too, keep it out of the shared library's
+ * exported symbols */
+#if defined(__GNUC__) && !defined(__TINYC__) && !defined(_WIN32)
+__attribute__((visibility("hidden")))
+#endif
 void __stderr_log(const char *type, const char *file, const int line,
                   const char *fmt, ...);
 
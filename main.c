@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <time.h>
 
 #define SDL_DISABLE_IMMINTRIN_H
 #define NK_BUTTON_TRIGGER_ON_RELEASE
@@ -21,12 +22,18 @@
 #include <emscripten/emscripten.h>
 #endif
 
-#include "tinyfiledialogs.h"
-#define SHEEP_LOG_IMPLEMENTATION
 #include "log.h"
 #include "chip8.h"
 #include "beeper.h"
 #include "input.h"
+#include "dialog.h"
+#include "stateio.h"
+#include "scheduler.h"
+#include "rewind.h"
+#include "quicksave.h"
+#include "movie.h"
+#include "timeline.h"
+#include "publish.h"
 
 #ifdef SDL_GetTicks64
 #define SDL_GetTicksCompat SDL_GetTicks64
@@ -41,6 +48,7 @@ static const char *preset_roms[] = { "roms/BRIX", "roms/octopaint.ch8", "roms/TE
 #endif
 
 static const int gui_top_px = 60;
+static const int kiosk_controls_px = 140;
 
 struct app {
     bool quit;
@@ -50,13 +58,33 @@ struct app {
     int tab;
     bool touchscreen_keypad;
     bool debug_window;
+    bool power_save; /* pause emulation and block on events while in background */
+    bool hidden, unfocused;
     struct nk_colorf bg, fg;
     struct nk_context *nk;
     uint64_t tick_a, tick_b;
+    uint64_t tick_prev; /* start of the previous frame, input timestamps are relative to it */
     int w, h;
     beeper_t beeper;
+    sched_t sched; /* instance 0 is chip, the rest are kiosks */
+    int focus; /* instance receiving keyboard input on the kiosk tab */
+    rewind_t rewind;
+    bool rewinding; /* rewind hotkey held */
+    quicksave_t quicksave;
+    movie_t movie;
+    bool recording, playing;
+    timeline_t timeline; /* debugger history of the primary instance */
+    timeline_cond debug_cond;
+    bool debug_paused;
+    publish_t publish; /* frames of the primary for other processes, if mapped */
+    uint8_t rom[MEMORY_SIZE - 0x200]; /* pristine copy of the primary rom, for resets */
+    uint32_t rom_size;
 #ifdef PLATFORM_WEB
     int selected_preset_rom;
+#else
+    dialog_t dialog;
+    stateio_t io;
+    char *state_path; /* last state file saved or loaded, read ahead on load */
 #endif
 };
 
@@ -65,6 +93,7 @@ enum app_tabs {
     tab_app_settings,
     tab_chip8_settings,
     tab_chip8_debug,
+    tab_kiosk,
     tab_counts,
 };
 
@@ -73,25 +102,35 @@ static const char *tab_names[] = {
     "Setting",
     "Chip8 Setting", 
     "Debug",
+    "Kiosk",
     "About",
     NULL,
 };
 
+static const char *sched_policy_names[] = {
+    "Round robin",
+    "Priority",
+};
+
 static struct app global_app = { 0 };
-#ifdef PLATFORM_WEB
-EMSCRIPTEN_KEEPALIVE int wasm_load_rom(uint8_t *buf, size_t size) {
-    chip8_load_rom(&global_app.chip, buf, size);
-    return 1;
-}
-#endif
 
 void app_init(struct app *app);
+void app_rom_loaded(struct app *app);
 void app_event(struct app *app);
 void app_draw(struct app *app);
 void app_draw_touchscreen_keypad(struct app *app);
 void app_draw_tab_chip8_screen(struct app *app);
 void app_draw_tab_settings(struct app *app);
 void app_draw_tab_chip8_settings(struct app *app);
+void app_draw_tab_kiosk(struct app *app);
+
+#ifdef PLATFORM_WEB
+EMSCRIPTEN_KEEPALIVE int wasm_load_rom(uint8_t *buf, size_t size) {
+    chip8_load_rom(&global_app.chip, buf, size);
+    app_rom_loaded(&global_app);
+    return 1;
+}
+#endif
 
 void app_init(struct app *app) {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
@@ -99,6 +138,7 @@ void app_init(struct app *app) {
 
     memset(app, 0, sizeof *app);
     chip8_init(&app->chip);
+    chip8_seed(&app->chip, time(NULL));
     app->win = SDL_CreateWindow("chip8 Emulator :D", 0, 0, 800, 600, SDL_WINDOW_SHOWN
 #ifndef PLATFORM_WEB
             | SDL_WINDOW_RESIZABLE
@@ -106,8 +146,9 @@ void app_init(struct app *app) {
             );
     app->renderer = SDL_CreateRenderer(app->win, -1, SDL_RENDERER_ACCELERATED);
     app->touchscreen_keypad = false;
+    app->power_save = true;
     app->tab = tab_chip8_screen;
-    app->tick_a = app->tick_b = SDL_GetTicksCompat();
+    app->tick_a = app->tick_b = app->tick_prev = SDL_GetTicksCompat();
     app->nk = nk_sdl_init(app->win, app->renderer);
     app->fg = (struct nk_colorf) {1.0f, 1.0f, 1.0f, 1.0f};
     app->bg = (struct nk_colorf) {0.0f, 0.0f, 0.0f, 1.0f};
@@ -120,16 +161,90 @@ void app_init(struct app *app) {
         nk_sdl_font_stash_end();
     }
     beeper_init(&app->beeper);
+#ifdef PLATFORM_WEB
+    sched_init(&app->sched, 0);
+#else
+    sched_init(&app->sched, SDL_GetCPUCount() - 1);
+#endif
+    sched_add(&app->sched, &app->chip);
+    rewind_init(&app->rewind);
+    quicksave_init(&app->quicksave);
+    movie_init(&app->movie);
+    timeline_init(&app->timeline);
+    timeline_attach(&app->timeline, &app->chip);
+    app->debug_cond = (timeline_cond){ .breakpoint = -1, .watchpoint = -1 };
+#ifndef PLATFORM_WEB
+    dialog_init(&app->dialog);
+    stateio_init(&app->io);
+#endif
 }
 
 
+/* movies only hold input, anything rewriting the state ends them */
+void app_movie_interrupt(struct app *app) {
+    if (app->recording) {
+        warn("State changed, movie recording stopped");
+        movie_stop(&app->movie, &app->chip);
+        app->recording = false;
+    }
+    app->playing = false;
+}
+
+/* debugger history only runs forward from its keyframes */
+void app_state_replaced(struct app *app) {
+    app_movie_interrupt(app);
+    timeline_reset(&app->timeline);
+}
+
+void app_rom_loaded(struct app *app) {
+    app_state_replaced(app);
+    app->rom_size = app->chip.rom_size;
+    memcpy(app->rom, app->chip.memory + 0x200, app->rom_size);
+#ifndef PLATFORM_WEB
+    quicksave_bind(&app->quicksave, chip8_rom_hash(&app->chip));
+#endif
+}
+
+/* power cycle the primary instance, clock speed and quirks survive */
+void app_reset(struct app *app) {
+    chip8 *fresh = malloc(sizeof *fresh);
+    if (fresh == NULL)
+        return;
+    chip8_init(fresh);
+    chip8_load_rom(fresh, app->rom, app->rom_size);
+    fresh->clockspeed = app->chip.clockspeed;
+    fresh->settings = app->chip.settings;
+    chip8_restore(&app->chip, fresh);
+    app->chip.input.head = app->chip.input.tail;
+    timeline_reset(&app->timeline);
+    free(fresh);
+}
+
+/* focus picks an instance on the kiosk tab only, the others show the primary */
+int app_focused(struct app *app) {
+    return app->tab == tab_kiosk ? app->focus : 0;
+}
+
+/* kiosk instances are laid out in a grid under the kiosk controls */
+SDL_Rect app_kiosk_cell(struct app *app, int id) {
+    int cols = 1;
+    while (cols * cols < app->sched.count)
+        cols++;
+    int rows = (app->sched.count + cols - 1) / cols;
+    int top = gui_top_px + kiosk_controls_px;
+    int w = app->w / cols, h = (app->h - top) / rows;
+    return (SDL_Rect){ .x = id % cols * w, .y = top + id / cols * h, .w = w, .h = h };
+}
 
 void app_event(struct app *app)
 {
     SDL_Event e;
     nk_input_begin(app->nk);
     while (SDL_PollEvent(&e)) {
-        chip8_input_handle(&app->chip, e);
+        /* a playing movie owns the primary instance's input */
+        int focused = app_focused(app);
+        if (!app->playing || focused != 0)
+            chip8_input_handle(app->sched.instances[focused].chip, e, app->tick_prev, app->tick_a);
         switch (e.type) {
             case SDL_QUIT:
                 app->quit = true;
@@ -137,6 +252,50 @@ void app_event(struct app *app)
                 exit(EXIT_SUCCESS);
 #endif
                 break;
+            case SDL_KEYDOWN: /* FALLTHROUGH */
+            case SDL_KEYUP:
+                if (e.key.keysym.sym == SDLK_BACKSPACE)
+                    app->rewinding = e.type == SDL_KEYDOWN;
+                /* F1-F10 load a quicksave slot, with shift they save it */
+                if (e.type == SDL_KEYDOWN && !e.key.repeat
+                        && e.key.keysym.sym >= SDLK_F1 && e.key.keysym.sym <= SDLK_F10) {
+                    int slot = e.key.keysym.sym - SDLK_F1;
+                    if (e.key.keysym.mod & KMOD_SHIFT)
+                        quicksave_save(&app->quicksave, slot, &app->chip, SDL_GetTicksCompat());
+                    else if (app->quicksave.slots[slot].used) {
+                        app_state_replaced(app);
+                        quicksave_load(&app->quicksave, slot, &app->chip);
+                    }
+                }
+                break;
+            case SDL_MOUSEBUTTONDOWN:
+                if (app->tab != tab_kiosk)
+                    break;
+                for (int i = 0; i < app->sched.count; i++) {
+                    SDL_Rect cell = app_kiosk_cell(app, i);
+                    if (e.button.x >= cell.x && e.button.x < cell.x + cell.w
+                            && e.button.y >= cell.y && e.button.y < cell.y + cell.h)
+                        app->focus = i;
+                }
+                break;
+            case SDL_WINDOWEVENT:
+                switch (e.window.event) {
+                    case SDL_WINDOWEVENT_HIDDEN: /* FALLTHROUGH */
+                    case SDL_WINDOWEVENT_MINIMIZED:
+                        app->hidden = true;
+                        break;
+                    case SDL_WINDOWEVENT_SHOWN: /* FALLTHROUGH */
+                    case SDL_WINDOWEVENT_RESTORED:
+                        app->hidden = false;
+                        break;
+                    case SDL_WINDOWEVENT_FOCUS_LOST:
+                        app->unfocused = true;
+                        break;
+                    case SDL_WINDOWEVENT_FOCUS_GAINED:
+                        app->unfocused = false;
+                        break;
+                }
+                break;
             default:
                 break;
         }
@@ -154,9 +313,8 @@ void app_draw_touchscreen_keypad(struct app *app) {
             for (int j = 0; j < 4; j++) {
                 int prev = app->chip.keys >> keypad[i+j].i & 1;
                 int res = nk_button_label(app->nk, keypad[i+j].t);
-                if (prev == res) continue;
-                if (res) chip8_keydown(&app->chip, keypad[i+j].i);
-                else chip8_keyup(&app->chip, keypad[i+j].i);
+                if (prev == res || app->playing) continue;
+                chip8_input_queue_key(&app->chip, app->chip.cycle, keypad[i+j].i, res);
             }
         }
         nk_end(app->nk);
@@ -164,30 +322,39 @@ void app_draw_touchscreen_keypad(struct app *app) {
     nk_button_set_behavior(app->nk, NK_BUTTON_DEFAULT);
 }
 
+void app_draw_thumb(struct app *app, const uint16_t *thumb) {
+    struct nk_rect bounds;
+    if (!nk_widget(&bounds, app->nk))
+        return;
+    struct nk_command_buffer *canvas = nk_window_get_canvas(app->nk);
+    struct nk_color bg = nk_rgb_cf(app->bg), fg = nk_rgb_cf(app->fg);
+    nk_fill_rect(canvas, bounds, 0, bg);
+    if (thumb == NULL)
+        return;
+    float pw = bounds.w / THUMB_WIDTH, ph = bounds.h / THUMB_HEIGHT;
+    for (int y = 0; y < THUMB_HEIGHT; y++)
+        for (int x = 0; x < THUMB_WIDTH; x++)
+            if (thumb[y] & 0x8000 >> x)
+                nk_fill_rect(canvas, nk_rect(bounds.x + x * pw, bounds.y + y * ph, pw, ph), 0, fg);
+}
+
 void app_draw_tab_settings(struct app *app) {
-    if (nk_begin(app->nk, "Settings", nk_rect(0, gui_top_px, app->w, 300), 0)) {
+    char buf[32];
+    if (nk_begin(app->nk, "Settings", nk_rect(0, gui_top_px, app->w, app->h - gui_top_px), 0)) {
         nk_layout_row_dynamic(app->nk, 150, 2);
         app->fg = nk_color_picker(app->nk, app->fg, NK_RGBA);
         app->bg = nk_color_picker(app->nk, app->bg, NK_RGBA);
 #ifndef PLATFORM_WEB
         nk_layout_row_dynamic(app->nk, 40, 2);
-        if (nk_button_label(app->nk, "Load Rom")) {
-            chip8_load_rom_from_file(&app->chip, 
-                    tinyfd_openFileDialog("Select rom file", "", 1, (const char *[]){ "*" },
-                        "binary file (chip8 rom)", false));
-            app->tab = tab_chip8_screen;
-        }
+        if (nk_button_label(app->nk, "Load Rom"))
+            dialog_open(&app->dialog, dialog_load_rom);
 
         nk_layout_row_dynamic(app->nk, 40, 2);
-        if (nk_button_label(app->nk, "Save state")) {
-            chip8_save_to_file(&app->chip, tinyfd_saveFileDialog(
-                    "Select where to save", "state", 1, (const char *[]){ "*" }, "binary file"));
-        }
-        if (nk_button_label(app->nk, "Load state")) {
-            chip8_restore_from_file(&app->chip, 
-                    tinyfd_openFileDialog("Select saved file", "", 1, (const char *[]){ "*" },
-                                          "binary file", false));
-        }
+        if (nk_button_label(app->nk, "Save state"))
+            dialog_open(&app->dialog, dialog_save_state);
+        if (nk_button_label(app->nk, "Load state") && dialog_open(&app->dialog, dialog_load_state)
+                && app->state_path != NULL)
+            stateio_prefetch(&app->io, app->state_path);
 #else
         nk_layout_row_dynamic(app->nk, 40, 1);
         if (nk_button_label(app->nk, "Upload Rom")) {
@@ -204,28 +371,71 @@ void app_draw_tab_settings(struct app *app) {
                 &app->selected_preset_rom, 20, (struct nk_vec2){150, 150});
         if (nk_button_label(app->nk, "Load selected preset")) {
             chip8_load_rom_from_file(&app->chip, preset_roms[app->selected_preset_rom]);
+            app_rom_loaded(app);
             app->tab = tab_chip8_screen;
         }
 #endif
         nk_layout_row_dynamic(app->nk, 40, 2);
         nk_checkbox_label(app->nk, "Touchscreen Keypad", &app->touchscreen_keypad);
         nk_checkbox_label(app->nk, "Debug window", &app->debug_window);
+        nk_layout_row_dynamic(app->nk, 40, 1);
+        nk_checkbox_label(app->nk, "Pause in background", &app->power_save);
+#ifndef PLATFORM_WEB
+        nk_layout_row_dynamic(app->nk, 40, 3);
+        if (nk_button_label(app->nk, app->recording ? "Recording..." : "Record movie")
+                && !app->recording && !app->playing) {
+            app_reset(app);
+            movie_record(&app->movie, &app->chip, time(NULL));
+            app->recording = true;
+            app->tab = tab_chip8_screen;
+        }
+        if (nk_button_label(app->nk, app->playing ? "Playing..." : "Play movie") && !app->recording)
+            dialog_open(&app->dialog, dialog_load_movie);
+        if (nk_button_label(app->nk, "Stop movie")) {
+            if (app->recording) {
+                movie_stop(&app->movie, &app->chip);
+                app->recording = false;
+                dialog_open(&app->dialog, dialog_save_movie);
+            }
+            app->playing = false;
+        }
+        nk_layout_row_dynamic(app->nk, 40, 1);
+        bool sharing = app->publish.map != NULL;
+        if (nk_checkbox_label(app->nk, "Publish frames to " PUBLISH_DEFAULT_NAME, &sharing)) {
+            if (sharing)
+                publish_open(&app->publish, PUBLISH_DEFAULT_NAME);
+            else
+                publish_close(&app->publish);
+        }
+#endif
+
+        nk_layout_row_dynamic(app->nk, 30, 1);
+        nk_label(app->nk, "Quicksave slots (Shift+F1-F10 save, F1-F10 load)", NK_TEXT_LEFT);
+        for (int i = 0; i < QUICKSAVE_SLOTS; i++) {
+            nk_layout_row_dynamic(app->nk, 40, 3);
+            app_draw_thumb(app, quicksave_thumb(&app->quicksave, i));
+            snprintf(buf, sizeof buf, "Save %d", i + 1);
+            if (nk_button_label(app->nk, buf))
+                quicksave_save(&app->quicksave, i, &app->chip, SDL_GetTicksCompat());
+            snprintf(buf, sizeof buf, "Load %d", i + 1);
+            if (nk_button_label(app->nk, buf) && app->quicksave.slots[i].used) {
+                app_state_replaced(app);
+                quicksave_load(&app->quicksave, i, &app->chip);
+            }
+        }
     }
     nk_end(app->nk);
 }
 
-void app_draw_tab_chip8_screen(struct app *app) {
-    int scalewidth = app->w / WIDTH;
-    int scaleheight = (app->h - gui_top_px) / HEIGHT;
-    if (scaleheight < 0) scaleheight = 0;
-    if (app->touchscreen_keypad || app->debug_window) scalewidth /= 2;
+void app_draw_screen(struct app *app, chip8 *chip, int left, int top,
+        int scalewidth, int scaleheight) {
     SDL_SetRenderDrawColor(app->renderer, app->fg.r * 255, app->fg.g * 255, app->fg.b * 255, 255);
     for (int y = 0; y < HEIGHT; y++) {
         for (int x = 0; x < WIDTH; x++) {
-            if (!app->chip.screen[y][x]) continue;
+            if (!chip->screen[y][x]) continue;
             SDL_RenderFillRect(app->renderer, &((SDL_Rect){
-                .x = x * scalewidth,
-                .y = y * scaleheight + gui_top_px,
+                .x = x * scalewidth + left,
+                .y = y * scaleheight + top,
                 .w = scalewidth,
                 .h = scaleheight
             }));
@@ -233,6 +443,51 @@ void app_draw_tab_chip8_screen(struct app *app) {
     }
 }
 
+void app_draw_tab_chip8_screen(struct app *app) {
+    int scalewidth = app->w / WIDTH;
+    int scaleheight = (app->h - gui_top_px) / HEIGHT;
+    if (scaleheight < 0) scaleheight = 0;
+    if (app->touchscreen_keypad || app->debug_window) scalewidth /= 2;
+    app_draw_screen(app, &app->chip, 0, gui_top_px, scalewidth, scaleheight);
+}
+
+void app_draw_tab_kiosk(struct app *app) {
+    char buf[256];
+    sched_instance *in = &app->sched.instances[app->focus];
+    if (nk_begin(app->nk, "Kiosk", nk_rect(0, gui_top_px, app->w, kiosk_controls_px),
+                NK_WINDOW_NO_SCROLLBAR)) {
+        nk_layout_row_dynamic(app->nk, 40, 4);
+#ifndef PLATFORM_WEB
+        if (nk_button_label(app->nk, "Add Rom"))
+            dialog_open(&app->dialog, dialog_add_instance);
+#endif
+        if (nk_button_label(app->nk, "Remove") && app->focus > 0) {
+            sched_remove(&app->sched, app->focus);
+            app->focus = 0;
+            in = &app->sched.instances[0];
+        }
+        app->sched.policy = nk_combo(app->nk, sched_policy_names,
+                sizeof sched_policy_names / sizeof *sched_policy_names,
+                app->sched.policy, 30, nk_vec2(200, 100));
+        snprintf(buf, sizeof buf, "#%d %.2fms %llu/%llu", app->focus, in->last_ns / 1e6,
+                (unsigned long long)in->skipped, (unsigned long long)in->frames);
+        nk_label(app->nk, buf, NK_TEXT_LEFT);
+        nk_layout_row_dynamic(app->nk, 40, 3);
+        nk_property_int(app->nk, "Clock", 0, &in->chip->clockspeed, 2000, 20, 5);
+        nk_property_int(app->nk, "Priority", 1, &in->priority, 16, 1, 1);
+        nk_property_float(app->nk, "Volume", 0, &in->volume, 1, 0.1f, 0.05f);
+    }
+    nk_end(app->nk);
+
+    for (int i = 0; i < app->sched.count; i++) {
+        SDL_Rect cell = app_kiosk_cell(app, i);
+        app_draw_screen(app, app->sched.instances[i].chip, cell.x, cell.y,
+                cell.w / WIDTH, cell.h / HEIGHT);
+        if (i == app->focus)
+            SDL_RenderDrawRect(app->renderer, &cell);
+    }
+}
+
 void app_draw_tab_chip8_settings(struct app *app) {
     if (nk_begin(app->nk, "Chip8 Settings", nk_rect(0, gui_top_px, app->w, 300), 0)) {
         nk_layout_row_dynamic(app->nk, 40, 2);
@@ -288,6 +543,56 @@ void app_draw_debug_window(struct app *app) {
             nk_label(app->nk, buf, NK_TEXT_RIGHT);
             nk_group_end(app->nk);
         }
+
+        chip8 *chip = &app->chip;
+        nk_layout_row_dynamic(app->nk, 30, 4);
+        if (nk_button_label(app->nk, app->debug_paused ? "Run" : "Pause"))
+            app->debug_paused = !app->debug_paused;
+        if (nk_button_label(app->nk, "Step")) {
+            app->debug_paused = true;
+            timeline_step(&app->timeline, chip);
+        }
+        if (nk_button_label(app->nk, "Step back")) {
+            app->debug_paused = true;
+            app_movie_interrupt(app);
+            timeline_step_back(&app->timeline, chip);
+        }
+        if (nk_button_label(app->nk, "Reverse")) {
+            app->debug_paused = true;
+            app_movie_interrupt(app);
+            timeline_reverse_continue(&app->timeline, chip, &app->debug_cond);
+        }
+        nk_layout_row_dynamic(app->nk, 30, 2);
+        nk_property_int(app->nk, "Break PC", -1, &app->debug_cond.breakpoint, MEMORY_SIZE - 1, 2, 1);
+        nk_property_int(app->nk, "Watch", -1, &app->debug_cond.watchpoint, MEMORY_SIZE - 1, 1, 1);
+
+        nk_layout_row_dynamic(app->nk, 20, 1);
+        snprintf(buf, sizeof buf, "OP: %04X  instr: %llu  cycle: %llu%s",
+                chip->pc + 1 < MEMORY_SIZE ? chip->memory[chip->pc] << 8 | chip->memory[chip->pc + 1] : 0,
+                (unsigned long long)chip->instret, (unsigned long long)chip->cycle,
+                chip->key_waiting ? "  waiting" : "");
+        nk_label(app->nk, buf, NK_TEXT_LEFT);
+        for (int row = 0; row < 2; row++) {
+            int len = 0;
+            for (int r = row * 8; r < row * 8 + 8; r++)
+                len += snprintf(buf + len, sizeof buf - len, "V%X:%02X ", r, chip->v[r]);
+            nk_label(app->nk, buf, NK_TEXT_LEFT);
+        }
+        snprintf(buf, sizeof buf, "History: %d keyframes, %zu events", app->timeline.count,
+                app->timeline.log_len);
+        nk_label(app->nk, buf, NK_TEXT_LEFT);
+        snprintf(buf, sizeof buf, "State hash: %016llx",
+                (unsigned long long)chip8_state_hash(chip));
+        nk_label(app->nk, buf, NK_TEXT_LEFT);
+
+        nk_layout_row_dynamic(app->nk, 20, 1);
+        snprintf(buf, sizeof buf, "Rewind: %d frames, %.1f KB", app->rewind.count,
+                app->rewind.bytes / 1024.0);
+        nk_label(app->nk, buf, NK_TEXT_LEFT);
+        snprintf(buf, sizeof buf, "Capture: %.2f us, %.1f KB/min, %llu dropped",
+                app->rewind.capture_ns / 1000, rewind_bytes_per_minute(&app->rewind) / 1024,
+                (unsigned long long)app->rewind.dropped);
+        nk_label(app->nk, buf, NK_TEXT_LEFT);
     }
     nk_end(app->nk);
 }
@@ -324,6 +629,9 @@ void app_draw(struct app *app) {
         case tab_chip8_settings:
             app_draw_tab_chip8_settings(app);
             break;
+        case tab_kiosk:
+            app_draw_tab_kiosk(app);
+            break;
     }
 
     if (app->touchscreen_keypad)
@@ -335,19 +643,150 @@ void app_draw(struct app *app) {
     SDL_RenderPresent(app->renderer);
 }
 
+#ifndef PLATFORM_WEB
+void app_handle_dialogs(struct app *app) {
+    dialog_result res;
+    while (dialog_poll(&app->dialog, &res)) {
+        if (res.path == NULL)
+            continue;
+        switch (res.kind) {
+            case dialog_load_rom:
+                chip8_load_rom_from_file(&app->chip, res.path);
+                app_rom_loaded(app);
+                app->tab = tab_chip8_screen;
+                break;
+            case dialog_save_state:
+                stateio_save(&app->io, res.path, &app->chip);
+                free(app->state_path);
+                app->state_path = res.path;
+                continue;
+            case dialog_load_state:
+                stateio_load(&app->io, res.path);
+                free(app->state_path);
+                app->state_path = res.path;
+                continue;
+            case dialog_save_movie:
+                movie_save(&app->movie, res.path);
+                break;
+            case dialog_load_movie:
+                if (movie_load(&app->movie, res.path) < 0)
+                    break;
+                app_state_replaced(app);
+                app_reset(app);
+                if (!movie_matches(&app->movie, &app->chip)) {
+                    warn("Movie was recorded with a different rom");
+                    break;
+                }
+                movie_play(&app->movie, &app->chip);
+                app->playing = true;
+                app->tab = tab_chip8_screen;
+                break;
+            case dialog_add_instance: {
+                int id = sched_add(&app->sched, NULL);
+                if (id < 0) {
+                    warn("Too many instances");
+                    break;
+                }
+                chip8_seed(app->sched.instances[id].chip, time(NULL) ^ (uint64_t)id << 32);
+                if (chip8_load_rom_from_file(app->sched.instances[id].chip, res.path) < 0) {
+                    sched_remove(&app->sched, id);
+                    break;
+                }
+                app->focus = id;
+                break;
+            }
+        }
+        free(res.path);
+    }
+}
+
+void app_handle_stateio(struct app *app) {
+    stateio_result res;
+    while (stateio_poll(&app->io, &res)) {
+        if (res.kind == stateio_kind_load && res.ok) {
+            app_state_replaced(app);
+            chip8_restore(&app->chip, res.chip);
+        }
+        free(res.chip);
+    }
+}
+#endif
+
+#ifndef PLATFORM_WEB
+/* slots go to the slot file once they have settled for a while, or at
+ * exit. the kernel writes the mapped pages back on its own schedule */
+void app_persist_quicksaves(struct app *app, bool all) {
+    uint64_t now = SDL_GetTicksCompat();
+    for (int i = 0; i < QUICKSAVE_SLOTS; i++) {
+        quicksave_slot *slot = &app->quicksave.slots[i];
+        if (slot->dirty && (all || now - slot->saved_at >= QUICKSAVE_PERSIST_MS))
+            quicksave_persist(&app->quicksave, i);
+    }
+}
+#endif
+
+bool app_paused(struct app *app) {
+#ifndef PLATFORM_WEB
+    /* our own file dialog steals focus, keep running behind it */
+    if (dialog_busy(&app->dialog))
+        return false;
+#endif
+    return app->power_save && (app->hidden || app->unfocused);
+}
+
 void app_run(struct app *app) {
+    if (app_paused(app)) {
+        beeper_pause(&app->beeper);
+#ifndef PLATFORM_WEB
+        /* sleep until the window manager or the user wakes us up */
+        SDL_WaitEvent(NULL);
+#endif
+        app_event(app);
+        if (!app->hidden)
+            app_draw(app);
+        /* don't try to catch up on the time spent asleep */
+        app->tick_a = app->tick_prev = SDL_GetTicksCompat();
+        return;
+    }
+
     app->tick_b = SDL_GetTicksCompat();
     if ((double)app->tick_b - app->tick_a < 1000.0f / 60)
         return;
+    app->tick_prev = app->tick_a;
     app->tick_a = SDL_GetTicksCompat();
 
     app_event(app);
-    if (app->tab == tab_chip8_screen) {
-        chip8_interpret(&app->chip);
-        chip8_update_timer(&app->chip);
+#ifndef PLATFORM_WEB
+    app_handle_dialogs(app);
+    app_handle_stateio(app);
+    app_persist_quicksaves(app, false);
+#endif
+    bool primary = app->tab == tab_chip8_screen || app->tab == tab_kiosk;
+    if (primary && app->rewinding) {
+        app_state_replaced(app);
+        rewind_step_back(&app->rewind, &app->chip);
+    }
+    if (primary && !app->rewinding && app->playing)
+        app->playing = movie_play_frame(&app->movie, &app->chip);
+    /* with the debugger stopping it the primary runs here, a step at a time */
+    bool debugging = app->debug_window && (app->debug_paused
+            || app->debug_cond.breakpoint >= 0 || app->debug_cond.watchpoint >= 0);
+    app->sched.instances[0].running = primary && !app->rewinding && !debugging;
+    sched_run_frame(&app->sched, 1000.0 / 60);
+    if (app->sched.instances[0].running) {
+        timeline_frame(&app->timeline, &app->chip);
+        rewind_capture(&app->rewind, &app->chip);
+        publish_frame(&app->publish, &app->chip);
+    } else if (primary && !app->rewinding && debugging && !app->debug_paused) {
+        app->debug_paused = timeline_run_frame(&app->timeline, &app->chip, &app->debug_cond);
+        if (!app->chip.in_frame) {
+            rewind_capture(&app->rewind, &app->chip);
+            publish_frame(&app->publish, &app->chip);
+        }
     }
 
-    if (app->chip.soundtimer > 0)
+    app->beeper.volume = sched_audio_level(&app->sched);
+    if (app->beeper.volume > 0)
         beeper_play(&app->beeper);
     else
         beeper_pause(&app->beeper);
@@ -368,6 +807,16 @@ int main(void) {
     emscripten_set_main_loop(app_main_loop, 0, 1);
 #else
     while (!global_app.quit) app_run(&global_app);
+    dialog_clean(&global_app.dialog);
+    app_persist_quicksaves(&global_app, true);
+    stateio_clean(&global_app.io);
+    free(global_app.state_path);
+    quicksave_clean(&global_app.quicksave);
+    movie_clean(&global_app.movie);
+    timeline_clean(&global_app.timeline);
+    publish_close(&global_app.publish);
+    sched_clean(&global_app.sched);
+    rewind_clean(&global_app.rewind);
     beeper_clean(&global_app.beeper);
 #endif
 
@@ -0,0 +1,246 @@
+#include "movie.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * movie file, every integer is little endian
+ *
+ *   "S8MV" u16 version, u16 reserved
+ *   u64 seed, u64 rom hash, u32 rom size, u32 clock speed, u32 quirk flags
+ *   u64 length in cycles, u64 final state hash
+ *   u32 stream length, stream
+ */
+
+#define MOVIE_VERSION 1
+#define MOVIE_HEADER 52
+
+static const uint8_t movie_magic[4] = { 'S', '8', 'M', 'V' };
+
+enum {
+    sett_8xy6_8xye_do_vy = 1 << 0,
+    sett_fx55_fx65_increment = 1 << 1,
+    sett_8xy1_2_3_reset_vf = 1 << 2,
+    sett_screen_wrap_around = 1 << 3,
+    sett_all = (1 << 4) - 1,
+};
+
+static bool movie_reserve(movie_t *movie, size_t n) {
+    if (movie->len + n <= movie->cap)
+        return true;
+    size_t cap = movie->cap ? movie->cap * 2 : 4096;
+    while (cap < movie->len + n)
+        cap *= 2;
+    uint8_t *data = realloc(movie->data, cap);
+    if (data == NULL)
+        return false;
+    movie->data = data;
+    movie->cap = cap;
+    return true;
+}
+
+static void put(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        p[i] = v >> (8 * i);
+}
+
+static uint64_t get(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+void movie_init(movie_t *movie) {
+    memset(movie, 0, sizeof *movie);
+}
+
+/* chip must be freshly reset with the rom loaded, recording lasts until
+ * movie_stop. every event pushed to the chip's input queue is captured */
+void movie_record(movie_t *movie, chip8 *chip, uint64_t seed) {
+    free(movie->data);
+    movie_init(movie);
+    chip8_seed(chip, seed);
+    movie->seed = seed;
+    movie->rom_hash = chip8_rom_hash(chip);
+    movie->rom_size = chip->rom_size;
+    movie->clockspeed = chip->clockspeed;
+    movie->settings = chip->settings;
+    movie->start = chip->cycle;
+    chip->input.record = movie;
+}
+
+void movie_record_event(movie_t *movie, chip8_input_event ev) {
+    uint64_t cycle = ev.cycle > movie->start ? ev.cycle - movie->start : 0;
+    /* the queue applies in push order, an event stamped before the one
+     * ahead of it takes effect together with it */
+    if (cycle < movie->last)
+        cycle = movie->last;
+    uint16_t keys = ev.down ? movie->keys | 1 << ev.key : movie->keys & ~(1 << ev.key);
+    if (!movie_reserve(movie, 12)) {
+        warn("Out of memory recording movie");
+        return;
+    }
+    for (uint64_t delta = cycle - movie->last; ; delta >>= 7) {
+        movie->data[movie->len++] = (delta & 0x7F) | (delta >= 0x80 ? 0x80 : 0);
+        if (delta < 0x80)
+            break;
+    }
+    put(movie->data + movie->len, keys, 2);
+    movie->len += 2;
+    movie->last = cycle;
+    movie->keys = keys;
+}
+
+void movie_stop(movie_t *movie, chip8 *chip) {
+    if (chip->input.record == movie) {
+        chip->input.record = NULL;
+        movie->length = chip->cycle - movie->start;
+        movie->end_hash = chip8_state_hash(chip);
+    }
+}
+
+bool movie_matches(const movie_t *movie, const chip8 *chip) {
+    return chip->rom_size == movie->rom_size && chip8_rom_hash(chip) == movie->rom_hash;
+}
+
+/* chip must be freshly reset with the movie's rom loaded */
+void movie_play(movie_t *movie, chip8 *chip) {
+    chip8_seed(chip, movie->seed);
+    chip->clockspeed = movie->clockspeed;
+    chip->settings = movie->settings;
+    movie->start = chip->cycle;
+    movie->last = 0;
+    movie->keys = 0;
+    movie->pos = 0;
+}
+
+/* queue the input of the frame chip is about to run, false once the movie
+ * has run out */
+bool movie_play_frame(movie_t *movie, chip8 *chip) {
+    uint64_t frame_end = chip->cycle + chip->clockspeed / 60;
+    while (movie->pos < movie->len) {
+        size_t pos = movie->pos;
+        uint64_t delta = 0;
+        for (int shift = 0; pos < movie->len && shift < 64; shift += 7) {
+            uint8_t b = movie->data[pos++];
+            delta |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+        if (pos + 2 > movie->len) {
+            movie->pos = movie->len;
+            break;
+        }
+        uint64_t cycle = movie->start + movie->last + delta;
+        if (cycle >= frame_end)
+            break;
+        uint16_t keys = get(movie->data + pos, 2);
+        uint16_t changed = keys ^ movie->keys;
+        for (int key = 0; key < 16; key++) {
+            if (!(changed & 1 << key))
+                continue;
+            chip8_input_event ev = { .cycle = cycle, .key = key, .down = keys >> key & 1 };
+            if (!chip8_input_push(chip, ev))
+                return true; /* resume from this entry next frame */
+            movie->keys ^= 1 << key;
+        }
+        movie->pos = pos + 2;
+        movie->last += delta;
+    }
+    if (chip->cycle < movie->start + movie->length)
+        return true;
+    if (chip->cycle == movie->start + movie->length
+            && chip8_state_hash(chip) != movie->end_hash)
+        warn("Movie desynced, the final state differs from the recording");
+    return false;
+}
+
+int movie_save(const movie_t *movie, const char *path) {
+    uint8_t header[MOVIE_HEADER];
+    memcpy(header, movie_magic, 4);
+    put(header + 4, MOVIE_VERSION, 2);
+    put(header + 6, 0, 2);
+    put(header + 8, movie->seed, 8);
+    put(header + 16, movie->rom_hash, 8);
+    put(header + 24, movie->rom_size, 4);
+    put(header + 28, movie->clockspeed, 4);
+    put(header + 32, (movie->settings.op_8xy6_8xye_do_vy ? sett_8xy6_8xye_do_vy : 0)
+            | (movie->settings.op_fx55_fx65_increment ? sett_fx55_fx65_increment : 0)
+            | (movie->settings.op_8xy1_2_3_reset_vf ? sett_8xy1_2_3_reset_vf : 0)
+            | (movie->settings.screen_wrap_around ? sett_screen_wrap_around : 0), 4);
+    put(header + 36, movie->length, 8);
+    put(header + 44, movie->end_hash, 8);
+    uint8_t len[4];
+    put(len, movie->len, 4);
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        warn("Failed to open movie file for writing");
+        return -1;
+    }
+    bool ok = fwrite(header, 1, sizeof header, fp) == sizeof header
+        && fwrite(len, 1, 4, fp) == 4
+        && fwrite(movie->data, 1, movie->len, fp) == movie->len;
+    if (fclose(fp) != 0 || !ok) {
+        warn("Failed writing movie file");
+        return -1;
+    }
+    return 0;
+}
+
+int movie_load(movie_t *movie, const char *path) {
+    uint8_t header[MOVIE_HEADER + 4];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        warn("Failed to open movie file");
+        return -1;
+    }
+    if (fread(header, 1, sizeof header, fp) != sizeof header
+            || memcmp(header, movie_magic, 4) != 0 || get(header + 4, 2) > MOVIE_VERSION) {
+        warn("Not a movie file");
+        fclose(fp);
+        return -1;
+    }
+    /* playback runs clockspeed / 60 cycles a frame until the length, under
+     * 60 that is none and the movie would never finish */
+    uint32_t clockspeed = get(header + 28, 4), flags = get(header + 32, 4);
+    if (clockspeed < 60 || clockspeed > MAX_CLOCK || (flags & ~sett_all) != 0) {
+        warn("Invalid movie file");
+        fclose(fp);
+        return -1;
+    }
+    size_t len = get(header + MOVIE_HEADER, 4);
+    uint8_t *data = malloc(len ? len : 1);
+    if (data == NULL || fread(data, 1, len, fp) != len) {
+        warn("Truncated movie file");
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    free(movie->data);
+    movie_init(movie);
+    movie->seed = get(header + 8, 8);
+    movie->rom_hash = get(header + 16, 8);
+    movie->rom_size = get(header + 24, 4);
+    movie->clockspeed = clockspeed;
+    movie->settings.op_8xy6_8xye_do_vy = flags & sett_8xy6_8xye_do_vy;
+    movie->settings.op_fx55_fx65_increment = flags & sett_fx55_fx65_increment;
+    movie->settings.op_8xy1_2_3_reset_vf = flags & sett_8xy1_2_3_reset_vf;
+    movie->settings.screen_wrap_around = flags & sett_screen_wrap_around;
+    movie->length = get(header + 36, 8);
+    movie->end_hash = get(header + 44, 8);
+    movie->data = data;
+    movie->len = movie->cap = len;
+    return 0;
+}
+
+void movie_clean(movie_t *movie) {
+    free(movie->data);
+    movie_init(movie);
+}
+
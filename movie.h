@@ -0,0 +1,46 @@
+#pragma once
+#ifndef MOVIE_H_
+#define MOVIE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+typedef struct movie movie_t;
+
+/* input movie, replays a session bit for bit given the same rom.
+ * the stream holds one entry per key change, the cycle delta since the
+ * previous change as a varint followed by the whole 16 key bitmask */
+struct movie {
+    uint64_t seed;
+    uint64_t rom_hash;
+    uint32_t rom_size;
+    int clockspeed;
+    chip8_settings settings;
+    uint64_t length; /* cycles covered */
+    uint64_t end_hash; /* chip8_state_hash at the end */
+
+    uint8_t *data;
+    size_t len, cap;
+
+    /* recording and playback cursor */
+    uint64_t start; /* chip cycle the movie began at */
+    uint64_t last; /* cycle of the previous entry, relative to start */
+    uint16_t keys;
+    size_t pos;
+};
+
+void movie_init(movie_t *movie);
+void movie_record(movie_t *movie, chip8 *chip, uint64_t seed);
+void movie_record_event(movie_t *movie, chip8_input_event ev);
+void movie_stop(movie_t *movie, chip8 *chip);
+bool movie_matches(const movie_t *movie, const chip8 *chip);
+void movie_play(movie_t *movie, chip8 *chip);
+bool movie_play_frame(movie_t *movie, chip8 *chip);
+int movie_save(const movie_t *movie, const char *path);
+int movie_load(movie_t *movie, const char *path);
+void movie_clean(movie_t *movie);
+
+#endif /* MOVIE_H_ */
+
@@ -0,0 +1,226 @@
+#define _POSIX_C_SOURCE 200809L
+#include "pool.h"
+#include "log.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__) && defined(__GNUC__) && !defined(__TINYC__)
+#define POOL_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#else
+#define POOL_THREADS 0
+#endif
+
+/* a thread's share of the current job, chunks [head, tail). the owner
+ * takes from the head, thieves cut off the tail */
+typedef struct {
+    pool_t *pool;
+    int id;
+    size_t head, tail;
+#if POOL_THREADS
+    pthread_t thread;
+    pthread_mutex_t lock;
+#endif
+} pool_worker;
+
+struct pool {
+    int nthreads; /* the caller is worker 0 */
+    pool_worker *workers;
+
+    /* the current job */
+    pool_task task;
+    void *ctx;
+    size_t count, grain;
+
+#if POOL_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned long job; /* bumped by every pool_run */
+    int busy; /* threads still working on it */
+    bool quit;
+#endif
+};
+
+#if POOL_THREADS
+
+static void pool_chunk(pool_t *pool, size_t chunk, int worker) {
+    size_t begin = chunk * pool->grain;
+    size_t end = begin + pool->grain < pool->count ? begin + pool->grain : pool->count;
+    for (size_t i = begin; i < end; i++)
+        pool->task(pool->ctx, i, worker);
+}
+
+static bool pool_take(pool_worker *w, size_t *chunk) {
+    pthread_mutex_lock(&w->lock);
+    bool got = w->head < w->tail;
+    if (got)
+        *chunk = w->head++;
+    pthread_mutex_unlock(&w->lock);
+    return got;
+}
+
+/* move the back half of the first victim with work left over to w */
+static bool pool_steal(pool_worker *w) {
+    pool_t *pool = w->pool;
+    for (int step = 1; step < pool->nthreads; step++) {
+        pool_worker *victim = &pool->workers[(w->id + step) % pool->nthreads];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->tail - victim->head;
+        size_t head = 0, tail = 0;
+        if (left > 0) {
+            tail = victim->tail;
+            head = victim->tail = victim->tail - (left + 1) / 2;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (left > 0) {
+            pthread_mutex_lock(&w->lock);
+            w->head = head;
+            w->tail = tail;
+            pthread_mutex_unlock(&w->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void pool_work(pool_worker *w) {
+    size_t chunk;
+    for (;;) {
+        while (pool_take(w, &chunk))
+            pool_chunk(w->pool, chunk, w->id);
+        if (!pool_steal(w))
+            return;
+    }
+}
+
+static void *pool_thread(void *arg) {
+    pool_worker *w = arg;
+    pool_t *pool = w->pool;
+    unsigned long seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->quit && pool->job == seen)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->job;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_work(w);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+#endif
+
+/* nthreads 0 is one per online core */
+pool_t *pool_new(int nthreads) {
+#if POOL_THREADS
+    if (nthreads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cores > 0 ? (int)cores : 1;
+    }
+    if (nthreads > POOL_MAX_THREADS)
+        nthreads = POOL_MAX_THREADS;
+#else
+    nthreads = 1;
+#endif
+    pool_t *pool = calloc(1, sizeof *pool);
+    if (pool == NULL)
+        return NULL;
+    pool->workers = calloc(nthreads, sizeof *pool->workers);
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->nthreads = nthreads;
+    for (int t = 0; t < nthreads; t++) {
+        pool->workers[t].pool = pool;
+        pool->workers[t].id = t;
+    }
+#if POOL_THREADS
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int t = 0; t < nthreads; t++)
+        pthread_mutex_init(&pool->workers[t].lock, NULL);
+    for (int t = 1; t < nthreads; t++) {
+        if (pthread_create(&pool->workers[t].thread, NULL, pool_thread, &pool->workers[t]) != 0) {
+            warn("Failed to start pool thread, running with %d", t);
+            pool->nthreads = t;
+            break;
+        }
+    }
+#endif
+    return pool;
+}
+
+int pool_threads(const pool_t *pool) {
+    return pool != NULL ? pool->nthreads : 1;
+}
+
+/* run task for every index below count and wait for all of them, the
+ * calling thread helps. a NULL pool runs them in order on the caller */
+void pool_run(pool_t *pool, size_t count, size_t grain, pool_task task, void *ctx) {
+    if (grain == 0)
+        grain = 1;
+    if (pool == NULL || pool->nthreads == 1 || count <= grain) {
+        for (size_t i = 0; i < count; i++)
+            task(ctx, i, 0);
+        return;
+    }
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->grain = grain;
+#if POOL_THREADS
+    size_t chunks = (count + grain - 1) / grain;
+    pthread_mutex_lock(&pool->lock);
+    for (int t = 0; t < pool->nthreads; t++) {
+        pool_worker *w = &pool->workers[t];
+        pthread_mutex_lock(&w->lock);
+        w->head = chunks * t / pool->nthreads;
+        w->tail = chunks * (t + 1) / pool->nthreads;
+        pthread_mutex_unlock(&w->lock);
+    }
+    pool->busy = pool->nthreads - 1;
+    pool->job++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_work(&pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+void pool_free(pool_t *pool) {
+    if (pool == NULL)
+        return;
+#if POOL_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 1; t < pool->nthreads; t++)
+        pthread_join(pool->workers[t].thread, NULL);
+    for (int t = 0; t < pool->nthreads; t++)
+        pthread_mutex_destroy(&pool->workers[t].lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stddef.h>
+
+#define POOL_MAX_THREADS 256
+
+/* task i of a job, worker is the thread running it, 0 to pool_threads - 1,
+ * for keeping per thread scratch */
+typedef void (*pool_task)(void *ctx, size_t i, int worker);
+
+typedef struct pool pool_t;
+
+/* work stealing thread pool. a job is count independent tasks cut into
+ * chunks of grain, dealt out in order as one range per thread. a thread
+ * works through its own range front to back and, once out, steals the
+ * back half of someone else's. any thread may end up running any task,
+ * so a task must only touch what belongs to its index, then results come
+ * out the same for every thread count.
+ *
+ * without pthreads and gcc style atomics (windows, tcc, the web build)
+ * there are no threads and jobs run on the caller */
+pool_t *pool_new(int nthreads);
+int pool_threads(const pool_t *pool);
+void pool_run(pool_t *pool, size_t count, size_t grain, pool_task task, void *ctx);
+void pool_free(pool_t *pool);
+
+#endif /* POOL_H_ */
@@ -0,0 +1,177 @@
+#define _POSIX_C_SOURCE 200809L
+#include "publish.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* the seqlock needs stores to land in order. without gcc style atomics
+ * that only holds on x86, and only because tcc does not reorder memory
+ * accesses either. elsewhere nothing is published */
+#if defined(__GNUC__) && !defined(__TINYC__)
+#define PUBLISH_ORDERED 1
+#define publish_load(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define publish_store(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define publish_fence(order) __atomic_thread_fence(order)
+#else
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define PUBLISH_ORDERED 1
+#else
+#define PUBLISH_ORDERED 0
+#endif
+#define publish_load(p) (*(volatile uint64_t *)(p))
+#define publish_store(p, v) (*(volatile uint64_t *)(p) = (v))
+#define publish_fence(order) ((void)0)
+#endif
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__) && PUBLISH_ORDERED
+#define PUBLISH_SHM 1
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define PUBLISH_SHM 0
+#endif
+
+static const char publish_magic[4] = { 'S', '8', 'F', 'B' };
+
+#if PUBLISH_SHM
+/* whether the existing segment called name was left by a writer that has
+ * since died. one still being set up is undersized or unstamped, and
+ * like any pid that cannot be checked it counts as alive */
+static bool publish_stale(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    const publish_shared *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof *map)
+        map = mmap(NULL, sizeof *map, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    bool stale = memcmp(map->magic, publish_magic, sizeof publish_magic) == 0
+        && map->pid > 0 && kill(map->pid, 0) != 0 && errno == ESRCH;
+    munmap((void *)map, sizeof *map);
+    return stale;
+}
+
+/* creates the segment called name, "/sheep8" style. one left behind by a
+ * writer known to have died is replaced, any other is left alone */
+bool publish_open(publish_t *pub, const char *name) {
+    memset(pub, 0, sizeof *pub);
+    snprintf(pub->name, sizeof pub->name, "%s%s", name[0] == '/' ? "" : "/", name);
+    int fd = shm_open(pub->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        if (!publish_stale(pub->name)) {
+            warn("Shared memory %s is in use by another emulator", pub->name);
+            return false;
+        }
+        shm_unlink(pub->name);
+        fd = shm_open(pub->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        warnerr("Failed to open shared memory %s", pub->name);
+        return false;
+    }
+    if (ftruncate(fd, sizeof *pub->map) != 0) {
+        warnerr("Failed to size shared memory %s", pub->name);
+        close(fd);
+        shm_unlink(pub->name);
+        return false;
+    }
+    void *map = mmap(NULL, sizeof *pub->map, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        warnerr("Failed to map shared memory %s", pub->name);
+        shm_unlink(pub->name);
+        return false;
+    }
+    pub->map = map;
+    /* a fresh segment is zeroed, readers wait for the magic */
+    pub->map->version = PUBLISH_VERSION;
+    pub->map->slots = PUBLISH_SLOTS;
+    pub->map->slot_size = sizeof(publish_slot);
+    pub->map->pid = getpid();
+    publish_fence(__ATOMIC_SEQ_CST);
+    memcpy(pub->map->magic, publish_magic, sizeof publish_magic);
+    return true;
+}
+
+/* readers that still have it mapped keep their copy */
+void publish_close(publish_t *pub) {
+    if (pub->map == NULL)
+        return;
+    munmap(pub->map, sizeof *pub->map);
+    shm_unlink(pub->name);
+    pub->map = NULL;
+}
+#else
+bool publish_open(publish_t *pub, const char *name) {
+    (void)name;
+    memset(pub, 0, sizeof *pub);
+    warn("Publishing frames is not supported on this platform or compiler");
+    return false;
+}
+
+void publish_close(publish_t *pub) {
+    pub->map = NULL;
+}
+#endif
+
+/* call when chip finishes a frame */
+void publish_frame(publish_t *pub, const chip8 *chip) {
+    if (pub->map == NULL)
+        return;
+    uint64_t frame = ++pub->frames;
+    publish_slot *s = &pub->map->slot[frame % PUBLISH_SLOTS];
+    uint64_t seq = s->seq;
+    publish_store(&s->seq, seq + 1);
+    publish_fence(__ATOMIC_RELEASE);
+    s->frame = frame;
+    s->cycle = chip->cycle;
+    s->instret = chip->instret;
+    s->state_hash = chip8_state_hash(chip);
+    s->screen_hash = chip->screen_hash;
+    s->keys = chip->keys;
+    s->pc = chip->pc;
+    s->i = chip->i;
+    memcpy(s->v, chip->v, sizeof s->v);
+    s->sp = chip->sp;
+    s->delaytimer = chip->delaytimer;
+    s->soundtimer = chip->soundtimer;
+    s->key_waiting = chip->key_waiting;
+    memcpy(s->stack, chip->stack, sizeof s->stack);
+    /* bools are bytes of 0 or 1 already */
+    for (int y = 0; y < HEIGHT; y++)
+        memcpy(s->screen[y], chip->screen[y], WIDTH);
+    publish_store(&s->seq, seq + 2);
+    publish_store(&pub->map->latest, frame);
+}
+
+/* copy of the newest frame for a reader, false if nothing was published
+ * yet or the writer kept lapping the copy */
+bool publish_read(const publish_shared *map, publish_slot *out) {
+    if (!PUBLISH_ORDERED)
+        return false;
+    if (memcmp(map->magic, publish_magic, sizeof publish_magic) != 0
+            || map->version != PUBLISH_VERSION || map->slot_size != sizeof *out)
+        return false;
+    for (int tries = 0; tries < 16; tries++) {
+        uint64_t frame = publish_load(&map->latest);
+        if (frame == 0)
+            return false;
+        const publish_slot *s = &map->slot[frame % PUBLISH_SLOTS];
+        uint64_t seq = publish_load(&s->seq);
+        if (seq & 1)
+            continue;
+        memcpy(out, s, sizeof *out);
+        publish_fence(__ATOMIC_ACQUIRE);
+        if (publish_load(&s->seq) == seq && out->frame == frame)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef PUBLISH_H_
+#define PUBLISH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+#define PUBLISH_VERSION 1
+#define PUBLISH_SLOTS 4 /* frames a reader has to copy one out before it is reused */
+#define PUBLISH_DEFAULT_NAME "/sheep8"
+
+/* one finished frame. seq is odd while the emulator is writing it, a
+ * reader that sees the same even seq before and after copying got a
+ * consistent frame */
+typedef struct {
+    uint64_t seq;
+    uint64_t frame; /* frames published so far, this one included */
+    uint64_t cycle, instret;
+    uint64_t state_hash, screen_hash;
+    uint32_t keys;
+    uint16_t pc, i;
+    uint8_t v[NUM_REGISTERS];
+    uint8_t sp, delaytimer, soundtimer;
+    bool key_waiting;
+    uint16_t stack[256];
+    uint8_t screen[HEIGHT][WIDTH]; /* 0 or 1 */
+} publish_slot;
+
+/* the whole segment, native byte order since only local processes see it.
+ * frame f sits in slot[f % PUBLISH_SLOTS] and latest is the newest frame
+ * done, 0 before the first */
+typedef struct {
+    char magic[4]; /* "S8FB" */
+    uint16_t version, slots;
+    uint32_t slot_size;
+    int32_t pid; /* of the writer, a second one refuses while it lives */
+    uint64_t latest;
+    publish_slot slot[PUBLISH_SLOTS];
+} publish_shared;
+
+typedef struct publish publish_t;
+
+/* every completed frame and the registers put in a posix shared memory
+ * segment for recorders, overlays and bots to map. writing never waits on
+ * readers, one that falls behind retries or skips ahead instead */
+struct publish {
+    publish_shared *map;
+    char name[64];
+    uint64_t frames;
+};
+
+bool publish_open(publish_t *pub, const char *name);
+void publish_frame(publish_t *pub, const chip8 *chip);
+bool publish_read(const publish_shared *map, publish_slot *out);
+void publish_close(publish_t *pub);
+
+#endif /* PUBLISH_H_ */
@@ -0,0 +1,86 @@
+#include "quicksave.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool quicksave_init(quicksave_t *qs) {
+    memset(qs, 0, sizeof *qs);
+    qs->file.fd = -1;
+    qs->states = malloc(QUICKSAVE_SLOTS * sizeof *qs->states);
+    if (qs->states == NULL) {
+        warn("Failed to allocate quicksave slots");
+        return false;
+    }
+    return true;
+}
+
+/* switch to the slots of another rom, the current ones are written out
+ * first and the ones an earlier session left for the new rom are read */
+void quicksave_bind(quicksave_t *qs, uint64_t rom_hash) {
+    if (qs->states == NULL || (qs->file.map != NULL && qs->file.rom_hash == rom_hash))
+        return;
+    for (int i = 0; i < QUICKSAVE_SLOTS; i++)
+        if (qs->slots[i].dirty)
+            quicksave_persist(qs, i);
+    slotfile_close(&qs->file);
+    memset(qs->slots, 0, sizeof qs->slots);
+    if (!slotfile_open(&qs->file, rom_hash))
+        return;
+    for (int i = 0; i < QUICKSAVE_SLOTS; i++)
+        if (slotfile_read(&qs->file, i, &qs->states[i]))
+            qs->slots[i].used = qs->slots[i].thumb_stale = true;
+}
+
+/* copy a slot into the mapped file, a memory copy and no syscalls */
+void quicksave_persist(quicksave_t *qs, int slot) {
+    if (qs->states == NULL || slot < 0 || slot >= QUICKSAVE_SLOTS || !qs->slots[slot].used)
+        return;
+    if (qs->file.map != NULL && !slotfile_write(&qs->file, slot, &qs->states[slot]))
+        warn("Failed to write save slot %d", slot + 1);
+    qs->slots[slot].dirty = false;
+}
+
+void quicksave_save(quicksave_t *qs, int slot, const chip8 *chip, uint64_t now) {
+    if (qs->states == NULL || slot < 0 || slot >= QUICKSAVE_SLOTS)
+        return;
+    qs->slots[slot].gen = chip8_snapshot(&qs->states[slot], chip,
+            qs->slots[slot].used ? qs->slots[slot].gen : 0);
+    qs->slots[slot].used = qs->slots[slot].dirty = qs->slots[slot].thumb_stale = true;
+    qs->slots[slot].saved_at = now;
+}
+
+bool quicksave_load(quicksave_t *qs, int slot, chip8 *chip) {
+    if (qs->states == NULL || slot < 0 || slot >= QUICKSAVE_SLOTS || !qs->slots[slot].used)
+        return false;
+    chip8_restore(chip, &qs->states[slot]);
+    return true;
+}
+
+/* downsampled screen of a slot, a thumbnail pixel is lit if any pixel of
+ * its block is. NULL for an empty slot */
+const uint16_t *quicksave_thumb(quicksave_t *qs, int slot) {
+    quicksave_slot *s = &qs->slots[slot];
+    if (!s->used)
+        return NULL;
+    if (s->thumb_stale) {
+        const chip8 *chip = &qs->states[slot];
+        memset(s->thumb, 0, sizeof s->thumb);
+        for (int y = 0; y < HEIGHT; y++)
+            for (int x = 0; x < WIDTH; x++)
+                if (chip->screen[y][x])
+                    s->thumb[y / THUMB_SCALE] |= 0x8000 >> (x / THUMB_SCALE);
+        s->thumb_stale = false;
+    }
+    return s->thumb;
+}
+
+void quicksave_clean(quicksave_t *qs) {
+    for (int i = 0; i < QUICKSAVE_SLOTS; i++)
+        if (qs->slots[i].dirty)
+            quicksave_persist(qs, i);
+    slotfile_close(&qs->file);
+    free(qs->states);
+    qs->states = NULL;
+}
+
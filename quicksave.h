@@ -0,0 +1,45 @@
+#pragma once
+#ifndef QUICKSAVE_H_
+#define QUICKSAVE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+#include "slotfile.h"
+
+#define QUICKSAVE_SLOTS SLOTFILE_SLOTS
+#define QUICKSAVE_PERSIST_MS 2000 /* how long a slot stays memory only */
+#define THUMB_SCALE 4
+#define THUMB_WIDTH (WIDTH / THUMB_SCALE)
+#define THUMB_HEIGHT (HEIGHT / THUMB_SCALE)
+
+typedef struct {
+    bool used;
+    bool dirty; /* not written to the slot file yet */
+    bool thumb_stale;
+    uint64_t saved_at; /* ticks */
+    uint64_t gen; /* chip8_snapshot generation the slot is at */
+    uint16_t thumb[THUMB_HEIGHT]; /* one bit a pixel, msb on the left */
+} quicksave_slot;
+
+typedef struct quicksave quicksave_t;
+
+/* in memory save slots, saving is a single copy into preallocated storage,
+ * thumbnails and copies into the rom's slot file are done later off the
+ * hot path */
+struct quicksave {
+    chip8 *states; /* QUICKSAVE_SLOTS of them */
+    quicksave_slot slots[QUICKSAVE_SLOTS];
+    slotfile_t file;
+};
+
+bool quicksave_init(quicksave_t *qs);
+void quicksave_save(quicksave_t *qs, int slot, const chip8 *chip, uint64_t now);
+bool quicksave_load(quicksave_t *qs, int slot, chip8 *chip);
+const uint16_t *quicksave_thumb(quicksave_t *qs, int slot);
+void quicksave_bind(quicksave_t *qs, uint64_t rom_hash);
+void quicksave_persist(quicksave_t *qs, int slot);
+void quicksave_clean(quicksave_t *qs);
+
+#endif /* QUICKSAVE_H_ */
+
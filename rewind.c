@@ -0,0 +1,178 @@
+#define SDL_DISABLE_IMMINTRIN_H
+#include "rewind.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REWIND_DELTA_MAX RLE_BOUND(sizeof(chip8))
+
+static void rewind_drop_oldest(rewind_t *rw) {
+    rw->bytes -= rw->entries[rw->first].len;
+    rw->first = (rw->first + 1) % REWIND_MAX_FRAMES;
+    rw->count--;
+}
+
+/* arena space for len bytes, evicting the oldest deltas it overlaps */
+static uint32_t rewind_alloc(rewind_t *rw, uint32_t len) {
+    if (rw->arena_pos + len > REWIND_ARENA_SIZE) {
+        /* wrap around, the oldest deltas sit in the tail we abandon */
+        while (rw->count > 0 && rw->entries[rw->first].offset >= rw->arena_pos)
+            rewind_drop_oldest(rw);
+        rw->arena_pos = 0;
+    }
+    uint32_t start = rw->arena_pos, end = start + len;
+    while (rw->count > 0) {
+        rewind_entry *old = &rw->entries[rw->first];
+        if (old->offset + old->len <= start || old->offset >= end)
+            break;
+        rewind_drop_oldest(rw);
+    }
+    if (rw->count == REWIND_MAX_FRAMES)
+        rewind_drop_oldest(rw);
+    rw->arena_pos = end;
+    return start;
+}
+
+/* worker side, runs without the lock */
+static void rewind_store(rewind_t *rw, const chip8 *snap) {
+    const uint8_t *src = (const uint8_t*)snap;
+    uint8_t *head = (uint8_t*)rw->head;
+    for (size_t i = 0; i < sizeof *snap; i++)
+        head[i] ^= src[i];
+    size_t len = rle_encode(head, sizeof *snap, rw->scratch, REWIND_DELTA_MAX);
+    memcpy(rw->head, snap, sizeof *snap);
+
+    SDL_LockMutex(rw->lock);
+    uint32_t offset = rewind_alloc(rw, len);
+    memcpy(rw->arena + offset, rw->scratch, len);
+    rw->entries[(rw->first + rw->count) % REWIND_MAX_FRAMES] = (rewind_entry){
+        .frame = rw->frames++, .offset = offset, .len = len,
+    };
+    rw->count++;
+    rw->bytes += len;
+    SDL_UnlockMutex(rw->lock);
+}
+
+static int rewind_thread(void *userdata) {
+    rewind_t *rw = userdata;
+    SDL_LockMutex(rw->lock);
+    for (;;) {
+        while (rw->pending_head == rw->pending_tail && !rw->quit)
+            SDL_CondWait(rw->cond, rw->lock);
+        if (rw->pending_head == rw->pending_tail)
+            break;
+        chip8 *snap = &rw->pending[rw->pending_head % REWIND_PENDING];
+        SDL_UnlockMutex(rw->lock);
+        rewind_store(rw, snap);
+        SDL_LockMutex(rw->lock);
+        rw->pending_head++;
+        SDL_CondBroadcast(rw->cond);
+    }
+    SDL_UnlockMutex(rw->lock);
+    return 0;
+}
+
+bool rewind_init(rewind_t *rw) {
+    memset(rw, 0, sizeof *rw);
+    rw->pending = malloc(REWIND_PENDING * sizeof *rw->pending);
+    rw->head = calloc(1, sizeof *rw->head);
+    rw->scratch = malloc(REWIND_DELTA_MAX);
+    rw->arena = malloc(REWIND_ARENA_SIZE);
+    rw->entries = malloc(REWIND_MAX_FRAMES * sizeof *rw->entries);
+    rw->lock = SDL_CreateMutex();
+    rw->cond = SDL_CreateCond();
+    if (rw->pending == NULL || rw->head == NULL || rw->scratch == NULL
+            || rw->arena == NULL || rw->entries == NULL) {
+        warn("Failed to allocate rewind buffer");
+        return false;
+    }
+    rw->thread = SDL_CreateThread(rewind_thread, "rewind", rw);
+    if (rw->thread == NULL) {
+        warn("Failed to create rewind thread, rewind is disabled");
+        return false;
+    }
+    return true;
+}
+
+/* called once per frame on the emulation thread, only copies the state */
+void rewind_capture(rewind_t *rw, const chip8 *chip) {
+    if (rw->thread == NULL)
+        return;
+    uint64_t start = SDL_GetPerformanceCounter();
+    SDL_LockMutex(rw->lock);
+    if (rw->pending_tail - rw->pending_head == REWIND_PENDING) {
+        /* worker fell behind, rewinding will just skip this frame */
+        rw->dropped++;
+        SDL_UnlockMutex(rw->lock);
+        return;
+    }
+    int i = rw->pending_tail % REWIND_PENDING;
+    SDL_UnlockMutex(rw->lock);
+    /* the slot still holds the capture from REWIND_PENDING frames ago */
+    rw->pending_gen[i] = chip8_snapshot(&rw->pending[i], chip, rw->pending_gen[i]);
+    SDL_LockMutex(rw->lock);
+    rw->pending_tail++;
+    SDL_CondSignal(rw->cond);
+    SDL_UnlockMutex(rw->lock);
+    double ns = (SDL_GetPerformanceCounter() - start) * 1e9 / SDL_GetPerformanceFrequency();
+    rw->capture_ns += (ns - rw->capture_ns) / 64;
+}
+
+/* replaces chip with the frame captured before the newest one and forgets
+ * the newest, false when history is exhausted */
+bool rewind_step_back(rewind_t *rw, chip8 *chip) {
+    if (rw->thread == NULL)
+        return false;
+    SDL_LockMutex(rw->lock);
+    while (rw->pending_head != rw->pending_tail)
+        SDL_CondWait(rw->cond, rw->lock);
+    int newest = (rw->first + rw->count - 1) % REWIND_MAX_FRAMES;
+    /* the very first delta is against nothing, there is no frame before it */
+    if (rw->count == 0 || rw->entries[newest].frame == 0) {
+        SDL_UnlockMutex(rw->lock);
+        return false;
+    }
+    rewind_entry *e = &rw->entries[newest];
+    size_t len = rle_decode(rw->arena + e->offset, e->len, rw->scratch, REWIND_DELTA_MAX);
+    if (len != sizeof *chip) {
+        SDL_UnlockMutex(rw->lock);
+        return false;
+    }
+    uint8_t *head = (uint8_t*)rw->head;
+    for (size_t i = 0; i < len; i++)
+        head[i] ^= rw->scratch[i];
+    rw->bytes -= e->len;
+    rw->arena_pos = e->offset;
+    rw->count--;
+    rw->frames--;
+    SDL_UnlockMutex(rw->lock);
+
+    chip8_restore(chip, rw->head);
+    return true;
+}
+
+double rewind_bytes_per_minute(rewind_t *rw) {
+    SDL_LockMutex(rw->lock);
+    double bpm = rw->count ? (double)rw->bytes / rw->count * 60 * 60 : 0;
+    SDL_UnlockMutex(rw->lock);
+    return bpm;
+}
+
+void rewind_clean(rewind_t *rw) {
+    if (rw->thread != NULL) {
+        SDL_LockMutex(rw->lock);
+        rw->quit = true;
+        SDL_CondSignal(rw->cond);
+        SDL_UnlockMutex(rw->lock);
+        SDL_WaitThread(rw->thread, NULL);
+    }
+    free(rw->pending);
+    free(rw->head);
+    free(rw->scratch);
+    free(rw->arena);
+    free(rw->entries);
+    SDL_DestroyCond(rw->cond);
+    SDL_DestroyMutex(rw->lock);
+}
+
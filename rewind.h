@@ -0,0 +1,55 @@
+#pragma once
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include "chip8.h"
+
+#define REWIND_ARENA_SIZE (8 << 20) /* compressed history */
+#define REWIND_MAX_FRAMES (60 * 60 * 5) /* five minutes at 60 fps */
+#define REWIND_PENDING 4 /* captures waiting for the worker */
+
+typedef struct {
+    uint64_t frame;
+    uint32_t offset, len;
+} rewind_entry;
+
+typedef struct rewind rewind_t;
+
+/* every captured frame is stored as the run length coded xor against the
+ * frame before it, walking the deltas from the newest state backwards
+ * rebuilds older frames. compression happens on a worker thread */
+struct rewind {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    bool quit;
+
+    chip8 *pending; /* REWIND_PENDING snapshots, filled by rewind_capture */
+    uint64_t pending_gen[REWIND_PENDING]; /* chip8_snapshot generation of each */
+    int pending_head, pending_tail;
+
+    chip8 *head; /* newest captured state, the deltas walk back from it */
+    uint8_t *scratch;
+    uint8_t *arena;
+    uint32_t arena_pos;
+    rewind_entry *entries; /* ring of REWIND_MAX_FRAMES */
+    int first, count;
+    uint64_t frames; /* captures so far, index of the next entry */
+
+    /* stats for the debug window */
+    uint64_t dropped;
+    double capture_ns; /* moving average of rewind_capture */
+    uint64_t bytes; /* compressed bytes currently held */
+};
+
+bool rewind_init(rewind_t *rw);
+void rewind_capture(rewind_t *rw, const chip8 *chip);
+bool rewind_step_back(rewind_t *rw, chip8 *chip);
+double rewind_bytes_per_minute(rewind_t *rw);
+void rewind_clean(rewind_t *rw);
+
+#endif /* REWIND_H_ */
+
@@ -0,0 +1,76 @@
+#include "rle.h"
+
+#include <string.h>
+
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN 130
+#define RLE_MAX_LITERAL 128
+
+/* emit n literal bytes ending right before src[in] */
+static size_t rle_literals(const uint8_t *src, size_t in, size_t n,
+        uint8_t *dst, size_t out, size_t cap) {
+    while (n > 0) {
+        size_t chunk = n > RLE_MAX_LITERAL ? RLE_MAX_LITERAL : n;
+        if (out + 1 + chunk > cap)
+            return 0;
+        dst[out++] = chunk - 1;
+        memcpy(dst + out, src + in - n, chunk);
+        out += chunk;
+        n -= chunk;
+    }
+    return out;
+}
+
+size_t rle_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    size_t in = 0, out = 0, lit = 0;
+    while (in < len) {
+        size_t run = 1;
+        while (in + run < len && run < RLE_MAX_RUN && src[in + run] == src[in])
+            run++;
+        if (run < RLE_MIN_RUN) {
+            in += run;
+            lit += run;
+            if (lit >= RLE_MAX_LITERAL) {
+                if (!(out = rle_literals(src, in - lit + RLE_MAX_LITERAL,
+                                RLE_MAX_LITERAL, dst, out, cap)))
+                    return 0;
+                lit -= RLE_MAX_LITERAL;
+            }
+            continue;
+        }
+        if (lit > 0 && !(out = rle_literals(src, in, lit, dst, out, cap)))
+            return 0;
+        lit = 0;
+        if (out + 2 > cap)
+            return 0;
+        dst[out++] = run + 125;
+        dst[out++] = src[in];
+        in += run;
+    }
+    if (lit > 0 && !(out = rle_literals(src, in, lit, dst, out, cap)))
+        return 0;
+    return out;
+}
+
+size_t rle_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    size_t in = 0, out = 0;
+    while (in < len) {
+        uint8_t c = src[in++];
+        if (c < 128) {
+            size_t n = c + 1;
+            if (in + n > len || out + n > cap)
+                return 0;
+            memcpy(dst + out, src + in, n);
+            in += n;
+            out += n;
+        } else {
+            size_t n = c - 125;
+            if (in >= len || out + n > cap)
+                return 0;
+            memset(dst + out, src[in++], n);
+            out += n;
+        }
+    }
+    return out;
+}
+
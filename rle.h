@@ -0,0 +1,18 @@
+#pragma once
+#ifndef RLE_H_
+#define RLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* worst case encoded size of n bytes */
+#define RLE_BOUND(n) ((n) + (n) / 128 + 1)
+
+/* packbits style run length coding, a control byte c < 128 is followed by
+ * c + 1 literal bytes, c >= 128 repeats the next byte c - 125 times.
+ * both return the number of bytes written to dst, 0 if it does not fit */
+size_t rle_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+size_t rle_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+#endif /* RLE_H_ */
+
@@ -0,0 +1,156 @@
+#define SDL_DISABLE_IMMINTRIN_H
+#include "scheduler.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void sched_run_instance(sched_t *sched, int id) {
+    sched_instance *in = &sched->instances[id];
+    uint64_t start = SDL_GetPerformanceCounter();
+    if (start > sched->deadline) {
+        in->skipped++;
+        return;
+    }
+    chip8_interpret(in->chip);
+    uint64_t ns = (SDL_GetPerformanceCounter() - start) * 1000000000.0
+        / SDL_GetPerformanceFrequency();
+    in->frames++;
+    in->busy_ns += ns;
+    in->last_ns = ns;
+    in->vruntime += (double)ns / in->priority;
+}
+
+/* caller holds the lock, returns with it held */
+static void sched_drain(sched_t *sched) {
+    while (sched->next < sched->norder) {
+        int id = sched->order[sched->next++];
+        SDL_UnlockMutex(sched->lock);
+        sched_run_instance(sched, id);
+        SDL_LockMutex(sched->lock);
+        if (--sched->remaining == 0)
+            SDL_CondSignal(sched->idle);
+    }
+}
+
+static int sched_worker(void *userdata) {
+    sched_t *sched = userdata;
+    SDL_LockMutex(sched->lock);
+    while (!sched->quit) {
+        sched_drain(sched);
+        SDL_CondWait(sched->work, sched->lock);
+    }
+    SDL_UnlockMutex(sched->lock);
+    return 0;
+}
+
+void sched_init(sched_t *sched, int nworkers) {
+    memset(sched, 0, sizeof *sched);
+    sched->policy = sched_round_robin;
+    sched->lock = SDL_CreateMutex();
+    sched->work = SDL_CreateCond();
+    sched->idle = SDL_CreateCond();
+    if (nworkers > SCHED_MAX_WORKERS)
+        nworkers = SCHED_MAX_WORKERS;
+    for (int i = 0; i < nworkers; i++) {
+        sched->workers[sched->nworkers] = SDL_CreateThread(sched_worker, "sched", sched);
+        if (sched->workers[sched->nworkers] == NULL) {
+            warn("Failed to create scheduler worker, running with %d", sched->nworkers);
+            break;
+        }
+        sched->nworkers++;
+    }
+}
+
+/* adopts chip, or allocates a fresh instance if chip is NULL,
+ * returns the instance id or -1 if the scheduler is full */
+int sched_add(sched_t *sched, chip8 *chip) {
+    if (sched->count == SCHED_MAX_INSTANCES)
+        return -1;
+    sched_instance *in = &sched->instances[sched->count];
+    memset(in, 0, sizeof *in);
+    if (chip == NULL) {
+        if ((chip = malloc(sizeof *chip)) == NULL)
+            return -1;
+        chip8_init(chip);
+        in->owned = true;
+    }
+    in->chip = chip;
+    in->running = true;
+    in->priority = 1;
+    in->volume = 1.0f;
+    /* start level with the others instead of owning the cpu until caught up */
+    for (int i = 0; i < sched->count; i++)
+        if (i == 0 || sched->instances[i].vruntime < in->vruntime)
+            in->vruntime = sched->instances[i].vruntime;
+    return sched->count++;
+}
+
+void sched_remove(sched_t *sched, int id) {
+    if (id < 0 || id >= sched->count)
+        return;
+    if (sched->instances[id].owned)
+        free(sched->instances[id].chip);
+    memmove(&sched->instances[id], &sched->instances[id + 1],
+            (sched->count - id - 1) * sizeof *sched->instances);
+    sched->count--;
+}
+
+static void sched_order(sched_t *sched) {
+    sched->norder = 0;
+    if (sched->count == 0)
+        return;
+    sched->rr_start = (sched->rr_start + 1) % sched->count;
+    for (int i = 0; i < sched->count; i++) {
+        int id = (sched->rr_start + i) % sched->count;
+        if (!sched->instances[id].running)
+            continue;
+        int j = sched->norder++;
+        if (sched->policy == sched_priority) {
+            /* insertion sort, most starved instance first */
+            double vr = sched->instances[id].vruntime;
+            for (; j > 0 && sched->instances[sched->order[j - 1]].vruntime > vr; j--)
+                sched->order[j] = sched->order[j - 1];
+        }
+        sched->order[j] = id;
+    }
+}
+
+/* instances not started within budget_ms are skipped for this frame */
+void sched_run_frame(sched_t *sched, double budget_ms) {
+    SDL_LockMutex(sched->lock);
+    sched_order(sched);
+    sched->next = 0;
+    sched->remaining = sched->norder;
+    sched->deadline = SDL_GetPerformanceCounter()
+        + budget_ms * SDL_GetPerformanceFrequency() / 1000.0;
+    SDL_CondBroadcast(sched->work);
+    sched_drain(sched);
+    while (sched->remaining > 0)
+        SDL_CondWait(sched->idle, sched->lock);
+    SDL_UnlockMutex(sched->lock);
+}
+
+/* mix of every beeping instance, 0 is silence */
+float sched_audio_level(sched_t *sched) {
+    float level = 0;
+    for (int i = 0; i < sched->count; i++)
+        if (sched->instances[i].running && sched->instances[i].chip->soundtimer > 0)
+            level += sched->instances[i].volume;
+    return level > 1.0f ? 1.0f : level;
+}
+
+void sched_clean(sched_t *sched) {
+    SDL_LockMutex(sched->lock);
+    sched->quit = true;
+    SDL_CondBroadcast(sched->work);
+    SDL_UnlockMutex(sched->lock);
+    for (int i = 0; i < sched->nworkers; i++)
+        SDL_WaitThread(sched->workers[i], NULL);
+    while (sched->count > 0)
+        sched_remove(sched, sched->count - 1);
+    SDL_DestroyCond(sched->idle);
+    SDL_DestroyCond(sched->work);
+    SDL_DestroyMutex(sched->lock);
+}
+
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include "chip8.h"
+
+#define SCHED_MAX_INSTANCES 16
+#define SCHED_MAX_WORKERS 8
+
+enum sched_policy {
+    sched_round_robin,
+    sched_priority,
+};
+
+typedef struct {
+    chip8 *chip;
+    bool owned; /* allocated by sched_add, freed on removal */
+    bool running;
+    int priority; /* share of cpu time under sched_priority, at least 1 */
+    float volume; /* weight in the audio mix */
+    /* fairness accounting, only touched by the thread running the instance */
+    uint64_t frames;
+    uint64_t skipped; /* frames dropped because the frame deadline passed */
+    uint64_t busy_ns;
+    uint64_t last_ns;
+    double vruntime; /* busy time divided by priority, lowest runs first */
+} sched_instance;
+
+typedef struct sched sched_t;
+
+/* hosts several independent chip8 instances and runs one frame of each on a
+ * worker pool, the calling thread helps out and waits for the frame to end */
+struct sched {
+    sched_instance instances[SCHED_MAX_INSTANCES];
+    int count;
+    enum sched_policy policy;
+    int rr_start;
+
+    SDL_Thread *workers[SCHED_MAX_WORKERS];
+    int nworkers;
+    SDL_mutex *lock;
+    SDL_cond *work, *idle;
+    bool quit;
+    int order[SCHED_MAX_INSTANCES];
+    int norder, next, remaining;
+    uint64_t deadline; /* performance counter value */
+};
+
+void sched_init(sched_t *sched, int nworkers);
+int sched_add(sched_t *sched, chip8 *chip);
+void sched_remove(sched_t *sched, int id);
+void sched_run_frame(sched_t *sched, double budget_ms);
+float sched_audio_level(sched_t *sched);
+void sched_clean(sched_t *sched);
+
+#endif /* SCHEDULER_H_ */
+
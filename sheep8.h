@@ -0,0 +1,30 @@
+#pragma once
+#ifndef SHEEP8_H_
+#define SHEEP8_H_
+
+/* libsheep8, the emulator core without SDL or any ui. link with
+ * -lsheep8, it needs nothing but the c library.
+ *
+ * the api is every function declared by the headers below. structs are
+ * public and their layout is part of the abi, it only changes together
+ * with SHEEP8_VERSION_MAJOR, which is also the shared library's soname */
+
+#include "chip8.h"
+#include "movie.h"
+#include "timeline.h"
+#include "cow.h"
+#include "slotfile.h"
+#include "batch.h"
+#include "pool.h"
+#include "env.h"
+#include "publish.h"
+
+#define SHEEP8_VERSION_MAJOR 1
+#define SHEEP8_VERSION_MINOR 6
+
+/* version the library was built as, compare against the macros to catch
+ * running with a different build than the one compiled against */
+int sheep8_version_major(void);
+int sheep8_version_minor(void);
+
+#endif /* SHEEP8_H_ */
@@ -0,0 +1,645 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "sheep8.h"
+
+#include <string.h>
+
+/* python bindings, import sheep8. memory, registers, the screen and the
+ * environment outputs are buffers straight over the emulator's own arrays,
+ * memoryview or numpy.asarray reads them without a copy. stepping lets go
+ * of the gil so several machines can run on python threads at once, the
+ * views must not be read while their machine is stepping */
+
+/* a read only buffer over part of owner, which it keeps alive */
+typedef struct {
+    PyObject_HEAD
+    PyObject *owner;
+    void *buf;
+    Py_ssize_t itemsize;
+    const char *format;
+    int ndim;
+    Py_ssize_t shape[3], strides[3];
+    bool contiguous;
+} view_object;
+
+static int view_getbuffer(PyObject *self, Py_buffer *out, int flags) {
+    view_object *view = (view_object *)self;
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "sheep8 views are read only");
+        return -1;
+    }
+    if (!view->contiguous && (flags & PyBUF_STRIDES) != PyBUF_STRIDES) {
+        PyErr_SetString(PyExc_BufferError, "sheep8 view is not contiguous");
+        return -1;
+    }
+    Py_ssize_t len = view->itemsize;
+    for (int d = 0; d < view->ndim; d++)
+        len *= view->shape[d];
+    out->buf = view->buf;
+    out->obj = Py_NewRef(self);
+    out->len = len;
+    out->readonly = 1;
+    out->itemsize = view->itemsize;
+    out->format = flags & PyBUF_FORMAT ? (char *)view->format : NULL;
+    out->ndim = view->ndim;
+    out->shape = flags & PyBUF_ND ? view->shape : NULL;
+    out->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? view->strides : NULL;
+    out->suboffsets = NULL;
+    out->internal = NULL;
+    return 0;
+}
+
+static void view_dealloc(PyObject *self) {
+    Py_XDECREF(((view_object *)self)->owner);
+    Py_TYPE(self)->tp_free(self);
+}
+
+static PyBufferProcs view_as_buffer = {
+    .bf_getbuffer = view_getbuffer,
+};
+
+static PyTypeObject view_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "sheep8.View",
+    .tp_doc = "Read only buffer over emulator state.",
+    .tp_basicsize = sizeof(view_object),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = view_dealloc,
+    .tp_as_buffer = &view_as_buffer,
+};
+
+/* C contiguous array of the given shape, -1 ends it */
+static view_object *view_alloc(PyObject *owner, void *buf, const char *format, Py_ssize_t itemsize,
+        Py_ssize_t d0, Py_ssize_t d1, Py_ssize_t d2) {
+    view_object *view = PyObject_New(view_object, &view_type);
+    if (view == NULL)
+        return NULL;
+    view->owner = Py_NewRef(owner);
+    view->buf = buf;
+    view->itemsize = itemsize;
+    view->format = format;
+    view->shape[0] = d0;
+    view->shape[1] = d1;
+    view->shape[2] = d2;
+    view->ndim = d1 < 0 ? 1 : d2 < 0 ? 2 : 3;
+    view->contiguous = true;
+    Py_ssize_t stride = itemsize;
+    for (int d = view->ndim - 1; d >= 0; d--) {
+        view->strides[d] = stride;
+        stride *= view->shape[d];
+    }
+    return view;
+}
+
+/* memoryview of view, which it takes over */
+static PyObject *view_wrap(view_object *view) {
+    if (view == NULL)
+        return NULL;
+    PyObject *mv = PyMemoryView_FromObject((PyObject *)view);
+    Py_DECREF(view);
+    return mv;
+}
+
+/* memoryview of a C contiguous array of the given shape, -1 ends it */
+static PyObject *view_new(PyObject *owner, void *buf, const char *format, Py_ssize_t itemsize,
+        Py_ssize_t d0, Py_ssize_t d1, Py_ssize_t d2) {
+    return view_wrap(view_alloc(owner, buf, format, itemsize, d0, d1, d2));
+}
+
+/* obj as a contiguous buffer of n items of itemsize bytes, any integer
+ * format of that size in native order will do */
+static int get_array(PyObject *obj, Py_buffer *buf, Py_ssize_t n, Py_ssize_t itemsize,
+        const char *what) {
+    if (PyObject_GetBuffer(obj, buf, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+        return -1;
+    const char *fmt = buf->format != NULL ? buf->format : "B";
+    if (*fmt == '@' || *fmt == '=')
+        fmt++;
+#if PY_BIG_ENDIAN
+    if (*fmt == '>' || *fmt == '!')
+        fmt++;
+#else
+    if (*fmt == '<')
+        fmt++;
+#endif
+    if (buf->itemsize != itemsize || strlen(fmt) != 1 || strchr("bBhHiIlLqQ", *fmt) == NULL
+            || buf->len != n * itemsize) {
+        PyErr_Format(PyExc_ValueError, "%s must be %zd integers of %zd bytes", what, n, itemsize);
+        PyBuffer_Release(buf);
+        return -1;
+    }
+    return 0;
+}
+
+/* rom as bytes-like, or a path to one */
+static int load_rom(chip8 *chip, PyObject *rom, int clock) {
+    chip8_init(chip);
+    if (clock > 0)
+        chip->clockspeed = clock;
+    if (!PyObject_CheckBuffer(rom)) {
+        PyObject *path;
+        if (!PyUnicode_FSConverter(rom, &path))
+            return -1;
+        int err = chip8_load_rom_from_file(chip, PyBytes_AS_STRING(path));
+        Py_DECREF(path);
+        if (err < 0) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, rom);
+            return -1;
+        }
+        return 0;
+    }
+    Py_buffer buf;
+    if (PyObject_GetBuffer(rom, &buf, PyBUF_SIMPLE) < 0)
+        return -1;
+    if (buf.len > MEMORY_SIZE - 0x200) {
+        PyBuffer_Release(&buf);
+        PyErr_SetString(PyExc_ValueError, "rom too big");
+        return -1;
+    }
+    chip8_load_rom(chip, buf.buf, buf.len);
+    PyBuffer_Release(&buf);
+    return 0;
+}
+
+/* a step runs without the gil, so calls on one object are kept from
+ * overlapping */
+static int enter(bool *busy) {
+    if (*busy) {
+        PyErr_SetString(PyExc_RuntimeError, "already stepping on another thread");
+        return -1;
+    }
+    *busy = true;
+    return 0;
+}
+
+typedef struct {
+    PyObject_HEAD
+    bool busy;
+    chip8 chip;
+} chip8_object;
+
+static int chip8_object_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"rom", "clock", "seed", NULL};
+    chip8_object *c = (chip8_object *)self;
+    PyObject *rom;
+    int clock = 0;
+    unsigned long long seed = DEFAULT_SEED;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iK", kwlist, &rom, &clock, &seed))
+        return -1;
+    if (c->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "already stepping on another thread");
+        return -1;
+    }
+    if (load_rom(&c->chip, rom, clock) < 0)
+        return -1;
+    chip8_seed(&c->chip, seed);
+    return 0;
+}
+
+static PyObject *chip8_object_step(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"frames", NULL};
+    chip8_object *c = (chip8_object *)self;
+    unsigned long long frames = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|K", kwlist, &frames))
+        return NULL;
+    if (enter(&c->busy) < 0)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    for (unsigned long long f = 0; f < frames; f++)
+        chip8_interpret(&c->chip);
+    Py_END_ALLOW_THREADS
+    c->busy = false;
+    Py_RETURN_NONE;
+}
+
+static PyObject *chip8_object_state_hash(PyObject *self, PyObject *unused) {
+    (void)unused;
+    return PyLong_FromUnsignedLongLong(chip8_state_hash(&((chip8_object *)self)->chip));
+}
+
+static PyMethodDef chip8_object_methods[] = {
+    {"step", (PyCFunction)(void (*)(void))chip8_object_step, METH_VARARGS | METH_KEYWORDS,
+        "step(frames=1)\nRun this many frames, without holding the GIL."},
+    {"state_hash", chip8_object_state_hash, METH_NOARGS,
+        "Hash of the whole machine state, as chip8_state_hash."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyObject *chip8_get_memory(PyObject *self, void *unused) {
+    (void)unused;
+    chip8 *chip = &((chip8_object *)self)->chip;
+    return view_new(self, chip->memory, "B", 1, MEMORY_SIZE, -1, -1);
+}
+
+static PyObject *chip8_get_v(PyObject *self, void *unused) {
+    (void)unused;
+    chip8 *chip = &((chip8_object *)self)->chip;
+    return view_new(self, chip->v, "B", 1, NUM_REGISTERS, -1, -1);
+}
+
+static PyObject *chip8_get_stack(PyObject *self, void *unused) {
+    (void)unused;
+    chip8 *chip = &((chip8_object *)self)->chip;
+    return view_new(self, chip->stack, "H", 2, 256, -1, -1);
+}
+
+static PyObject *chip8_get_screen(PyObject *self, void *unused) {
+    (void)unused;
+    chip8 *chip = &((chip8_object *)self)->chip;
+    /* the drawn HEIGHT x WIDTH corner of the larger array */
+    view_object *view = view_alloc(self, chip->screen, "?", 1, HEIGHT, WIDTH, -1);
+    if (view != NULL) {
+        view->strides[0] = sizeof *chip->screen;
+        view->contiguous = false;
+    }
+    return view_wrap(view);
+}
+
+/* the scalar registers, closure is the offset of the field */
+#define CHIP8_FIELD(field) (void *)offsetof(chip8, field)
+
+static PyObject *chip8_get_u8(PyObject *self, void *field) {
+    return PyLong_FromLong(*((uint8_t *)&((chip8_object *)self)->chip + (size_t)field));
+}
+
+static PyObject *chip8_get_u16(PyObject *self, void *field) {
+    uint16_t val;
+    memcpy(&val, (uint8_t *)&((chip8_object *)self)->chip + (size_t)field, sizeof val);
+    return PyLong_FromLong(val);
+}
+
+static PyObject *chip8_get_u64(PyObject *self, void *field) {
+    uint64_t val;
+    memcpy(&val, (uint8_t *)&((chip8_object *)self)->chip + (size_t)field, sizeof val);
+    return PyLong_FromUnsignedLongLong(val);
+}
+
+static PyObject *chip8_get_keys(PyObject *self, void *unused) {
+    (void)unused;
+    return PyLong_FromUnsignedLong(((chip8_object *)self)->chip.keys);
+}
+
+/* keys going up release a pending fx0a like the frontend would */
+static int chip8_set_keys(PyObject *self, PyObject *value, void *unused) {
+    (void)unused;
+    chip8_object *c = (chip8_object *)self;
+    if (value == NULL) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete keys");
+        return -1;
+    }
+    unsigned long keys = PyLong_AsUnsignedLong(value);
+    if (PyErr_Occurred())
+        return -1;
+    if (c->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "already stepping on another thread");
+        return -1;
+    }
+    for (int key = 0; key < 16; key++) {
+        bool down = keys >> key & 1, was = c->chip.keys >> key & 1;
+        if (down && !was)
+            chip8_keydown(&c->chip, key);
+        else if (!down && was)
+            chip8_keyup(&c->chip, key);
+    }
+    return 0;
+}
+
+static PyGetSetDef chip8_object_getset[] = {
+    {"memory", chip8_get_memory, NULL, "memory, uint8", NULL},
+    {"v", chip8_get_v, NULL, "v0 to vf, uint8", NULL},
+    {"stack", chip8_get_stack, NULL, "call stack, uint16", NULL},
+    {"screen", chip8_get_screen, NULL, "screen[y][x], bool", NULL},
+    {"pc", chip8_get_u16, NULL, NULL, CHIP8_FIELD(pc)},
+    {"i", chip8_get_u16, NULL, NULL, CHIP8_FIELD(i)},
+    {"sp", chip8_get_u8, NULL, NULL, CHIP8_FIELD(sp)},
+    {"delaytimer", chip8_get_u8, NULL, NULL, CHIP8_FIELD(delaytimer)},
+    {"soundtimer", chip8_get_u8, NULL, NULL, CHIP8_FIELD(soundtimer)},
+    {"cycle", chip8_get_u64, NULL, NULL, CHIP8_FIELD(cycle)},
+    {"instret", chip8_get_u64, NULL, NULL, CHIP8_FIELD(instret)},
+    {"keys", chip8_get_keys, chip8_set_keys, "held keys, bit k for key k", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyTypeObject chip8_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "sheep8.Chip8",
+    .tp_doc = "Chip8(rom, clock=0, seed=DEFAULT_SEED)\n"
+        "One machine running rom, given as bytes or a path.",
+    .tp_basicsize = sizeof(chip8_object),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = chip8_object_init,
+    .tp_methods = chip8_object_methods,
+    .tp_getset = chip8_object_getset,
+};
+
+typedef struct {
+    PyObject_HEAD
+    bool busy;
+    env_t *env;
+    uint8_t *obs;
+    float *rewards;
+    uint8_t *dones;
+} env_object;
+
+static int env_parse_reward(PyObject *item, env_reward *rw) {
+    unsigned int addr;
+    const char *kind = "byte";
+    float scale = 1;
+    if (!PyArg_ParseTuple(item, "I|sf;rewards are (addr, kind, scale)", &addr, &kind, &scale))
+        return -1;
+    rw->addr = addr;
+    rw->scale = scale;
+    if (strcmp(kind, "byte") == 0)
+        rw->kind = env_score_byte;
+    else if (strcmp(kind, "word") == 0)
+        rw->kind = env_score_word;
+    else if (strcmp(kind, "bcd") == 0)
+        rw->kind = env_score_bcd;
+    else {
+        PyErr_Format(PyExc_ValueError, "reward kind %s is not byte, word or bcd", kind);
+        return -1;
+    }
+    return 0;
+}
+
+static int env_object_init(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"rom", "n", "frameskip", "obs", "actions", "rewards", "done_addr",
+        "done_value", "done_on_halt", "max_frames", "threads", "clock", NULL};
+    env_object *e = (env_object *)self;
+    PyObject *rom, *actions = Py_None, *rewards = Py_None;
+    Py_ssize_t n;
+    int frameskip = 1, done_addr = -1, done_value = 0, done_on_halt = 0, threads = 1, clock = 0;
+    const char *obs = "bits";
+    unsigned long long max_frames = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "On|isOOiipKii", kwlist, &rom, &n, &frameskip,
+                &obs, &actions, &rewards, &done_addr, &done_value, &done_on_halt, &max_frames,
+                &threads, &clock))
+        return -1;
+    if (e->env != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Env is already initialised");
+        return -1;
+    }
+    if (n <= 0) {
+        PyErr_SetString(PyExc_ValueError, "n must be positive");
+        return -1;
+    }
+
+    env_config cfg = {
+        .n = n,
+        .frameskip = frameskip,
+        .done_addr = done_addr,
+        .done_value = done_value,
+        .done_on_halt = done_on_halt,
+        .max_frames = max_frames,
+        .threads = threads,
+    };
+    if (strcmp(obs, "bits") == 0)
+        cfg.obs = env_obs_bits;
+    else if (strcmp(obs, "bytes") == 0)
+        cfg.obs = env_obs_bytes;
+    else {
+        PyErr_Format(PyExc_ValueError, "obs %s is not bits or bytes", obs);
+        return -1;
+    }
+
+    uint16_t *keys = NULL;
+    if (actions != Py_None) {
+        PyObject *seq = PySequence_Fast(actions, "actions must be a sequence of keypads");
+        if (seq == NULL)
+            return -1;
+        cfg.action_count = PySequence_Fast_GET_SIZE(seq);
+        if (cfg.action_count == 0) {
+            PyErr_SetString(PyExc_ValueError, "actions must not be empty");
+            Py_DECREF(seq);
+            return -1;
+        }
+        keys = PyMem_Calloc(cfg.action_count + 1, sizeof *keys);
+        for (size_t a = 0; keys != NULL && a < cfg.action_count; a++) {
+            unsigned long pad = PyLong_AsUnsignedLong(PySequence_Fast_GET_ITEM(seq, a));
+            if (PyErr_Occurred())
+                break;
+            if (pad > 0xFFFF) {
+                PyErr_Format(PyExc_ValueError, "keypad %lu does not fit in 16 bits", pad);
+                break;
+            }
+            keys[a] = pad;
+        }
+        Py_DECREF(seq);
+        if (keys == NULL)
+            PyErr_NoMemory();
+        if (PyErr_Occurred()) {
+            PyMem_Free(keys);
+            return -1;
+        }
+        cfg.action_keys = keys;
+    }
+    if (rewards != Py_None) {
+        PyObject *seq = PySequence_Fast(rewards, "rewards must be a sequence");
+        if (seq == NULL)
+            goto fail;
+        if (PySequence_Fast_GET_SIZE(seq) > ENV_MAX_REWARDS) {
+            PyErr_Format(PyExc_ValueError, "at most %d rewards", ENV_MAX_REWARDS);
+            Py_DECREF(seq);
+            goto fail;
+        }
+        cfg.nrewards = PySequence_Fast_GET_SIZE(seq);
+        for (int r = 0; r < cfg.nrewards; r++) {
+            if (env_parse_reward(PySequence_Fast_GET_ITEM(seq, r), &cfg.rewards[r]) < 0) {
+                Py_DECREF(seq);
+                goto fail;
+            }
+        }
+        Py_DECREF(seq);
+    }
+
+    chip8 *proto = PyMem_Malloc(sizeof *proto);
+    if (proto == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    if (load_rom(proto, rom, clock) < 0) {
+        PyMem_Free(proto);
+        goto fail;
+    }
+    e->env = env_new(proto, &cfg);
+    PyMem_Free(proto);
+    PyMem_Free(keys);
+    keys = NULL;
+    if (e->env == NULL) {
+        PyErr_SetString(PyExc_ValueError, "could not make the environment");
+        return -1;
+    }
+    e->obs = PyMem_Calloc(n, env_obs_size(e->env));
+    e->rewards = PyMem_Calloc(n, sizeof *e->rewards);
+    e->dones = PyMem_Calloc(n, sizeof *e->dones);
+    if (e->obs == NULL || e->rewards == NULL || e->dones == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (!env_reset(e->env, NULL, e->obs)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+fail:
+    PyMem_Free(keys);
+    return -1;
+}
+
+static void env_object_dealloc(PyObject *self) {
+    env_object *e = (env_object *)self;
+    env_free(e->env);
+    PyMem_Free(e->obs);
+    PyMem_Free(e->rewards);
+    PyMem_Free(e->dones);
+    Py_TYPE(self)->tp_free(self);
+}
+
+static int env_check(env_object *e) {
+    if (e->env == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Env is not initialised");
+        return -1;
+    }
+    return enter(&e->busy);
+}
+
+static PyObject *env_get_obs(PyObject *self, void *unused) {
+    (void)unused;
+    env_object *e = (env_object *)self;
+    if (e->env == NULL)
+        Py_RETURN_NONE;
+    if (e->env->cfg.obs == env_obs_bits)
+        return view_new(self, e->obs, "B", 1, e->env->cfg.n, HEIGHT * WIDTH / 8, -1);
+    return view_new(self, e->obs, "B", 1, e->env->cfg.n, HEIGHT, WIDTH);
+}
+
+static PyObject *env_get_rewards(PyObject *self, void *unused) {
+    (void)unused;
+    env_object *e = (env_object *)self;
+    if (e->env == NULL)
+        Py_RETURN_NONE;
+    return view_new(self, e->rewards, "f", sizeof *e->rewards, e->env->cfg.n, -1, -1);
+}
+
+static PyObject *env_get_dones(PyObject *self, void *unused) {
+    (void)unused;
+    env_object *e = (env_object *)self;
+    if (e->env == NULL)
+        Py_RETURN_NONE;
+    return view_new(self, e->dones, "B", 1, e->env->cfg.n, -1, -1);
+}
+
+static PyObject *env_object_reset(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"seeds", NULL};
+    env_object *e = (env_object *)self;
+    PyObject *seeds = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &seeds))
+        return NULL;
+    if (env_check(e) < 0)
+        return NULL;
+    Py_buffer buf = {0};
+    if (seeds != Py_None && get_array(seeds, &buf, e->env->cfg.n, 8, "seeds") < 0) {
+        e->busy = false;
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = env_reset(e->env, buf.buf, e->obs);
+    Py_END_ALLOW_THREADS
+    if (buf.obj != NULL)
+        PyBuffer_Release(&buf);
+    if (!ok) {
+        e->busy = false;
+        return PyErr_NoMemory();
+    }
+    memset(e->rewards, 0, e->env->cfg.n * sizeof *e->rewards);
+    memset(e->dones, 0, e->env->cfg.n);
+    e->busy = false;
+    return env_get_obs(self, NULL);
+}
+
+static PyObject *env_object_step(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"actions", NULL};
+    env_object *e = (env_object *)self;
+    PyObject *actions = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &actions))
+        return NULL;
+    if (env_check(e) < 0)
+        return NULL;
+    Py_buffer buf = {0};
+    if (actions != Py_None && get_array(actions, &buf, e->env->cfg.n, 4, "actions") < 0) {
+        e->busy = false;
+        return NULL;
+    }
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = env_step(e->env, buf.buf, e->obs, e->rewards, e->dones);
+    Py_END_ALLOW_THREADS
+    if (buf.obj != NULL)
+        PyBuffer_Release(&buf);
+    e->busy = false;
+    if (!ok)
+        return PyErr_NoMemory();
+    return Py_BuildValue("NNN", env_get_obs(self, NULL), env_get_rewards(self, NULL),
+            env_get_dones(self, NULL));
+}
+
+static PyMethodDef env_object_methods[] = {
+    {"reset", (PyCFunction)(void (*)(void))env_object_reset, METH_VARARGS | METH_KEYWORDS,
+        "reset(seeds=None)\nStart every instance over, seeds is n uint64. Returns obs."},
+    {"step", (PyCFunction)(void (*)(void))env_object_step, METH_VARARGS | METH_KEYWORDS,
+        "step(actions=None)\nHold actions, n int32, for frameskip frames without the GIL.\n"
+        "Returns (obs, rewards, dones), views that the next step overwrites."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef env_object_getset[] = {
+    {"obs", env_get_obs, NULL, "observations, n by 256 packed or n by 32 by 64 bytes", NULL},
+    {"rewards", env_get_rewards, NULL, "rewards of the last step, float32", NULL},
+    {"dones", env_get_dones, NULL, "1 terminated, 2 truncated, uint8", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyTypeObject env_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "sheep8.Env",
+    .tp_doc = "Env(rom, n, frameskip=1, obs='bits', actions=None, rewards=None,\n"
+        "    done_addr=-1, done_value=0, done_on_halt=False, max_frames=0, threads=1, clock=0)\n"
+        "n instances of rom as a vectorized environment, see env.h.\n"
+        "rewards is a sequence of (addr, 'byte' | 'word' | 'bcd', scale).",
+    .tp_basicsize = sizeof(env_object),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = env_object_init,
+    .tp_dealloc = env_object_dealloc,
+    .tp_methods = env_object_methods,
+    .tp_getset = env_object_getset,
+};
+
+static struct PyModuleDef sheep8_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "sheep8",
+    .m_doc = "Chip8 emulator core.",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_sheep8(void) {
+    if (PyType_Ready(&view_type) < 0 || PyType_Ready(&chip8_type) < 0
+            || PyType_Ready(&env_type) < 0)
+        return NULL;
+    PyObject *m = PyModule_Create(&sheep8_module);
+    if (m == NULL)
+        return NULL;
+    if (PyModule_AddObjectRef(m, "Chip8", (PyObject *)&chip8_type) < 0
+            || PyModule_AddObjectRef(m, "Env", (PyObject *)&env_type) < 0
+            || PyModule_AddIntConstant(m, "WIDTH", WIDTH) < 0
+            || PyModule_AddIntConstant(m, "HEIGHT", HEIGHT) < 0
+            || PyModule_AddIntConstant(m, "TERMINATED", ENV_TERMINATED) < 0
+            || PyModule_AddIntConstant(m, "TRUNCATED", ENV_TRUNCATED) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,177 @@
+#define _POSIX_C_SOURCE 200809L
+#include "slotfile.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * slot file, every integer is little endian
+ *
+ *   header page: "S8SL" u16 version, u16 slots, u32 record size, u64 rom hash
+ *   two records per slot, slot n at records 2n and 2n+1, each
+ *     u64 sequence number (0 empty), u32 reserved, u32 state length,
+ *     savestate as written by chip8_state_encode
+ */
+
+#define SLOTFILE_VERSION 1
+
+static const uint8_t slotfile_magic[4] = { 'S', '8', 'S', 'L' };
+
+#if defined(__GNUC__) && !defined(__TINYC__)
+#define slotfile_barrier() __sync_synchronize()
+#else
+#define slotfile_barrier() ((void)0)
+#endif
+
+static void put(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        p[i] = v >> (8 * i);
+}
+
+static uint64_t get(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static uint8_t *slotfile_record(slotfile_t *sf, int slot, int which) {
+    return sf->map + SLOTFILE_HEADER + (size_t)(slot * 2 + which) * SLOTFILE_RECORD;
+}
+
+void slotfile_path(uint64_t rom_hash, char *buf, size_t size) {
+    snprintf(buf, size, "sheep8-%016llx.slots", (unsigned long long)rom_hash);
+}
+
+#ifdef _WIN32
+bool slotfile_open(slotfile_t *sf, uint64_t rom_hash) {
+    memset(sf, 0, sizeof *sf);
+    sf->fd = -1;
+    sf->rom_hash = rom_hash;
+    warn("Save slot files are not supported on this platform");
+    return false;
+}
+
+void slotfile_sync(slotfile_t *sf) {
+    (void)sf;
+}
+
+void slotfile_close(slotfile_t *sf) {
+    sf->map = NULL;
+}
+#else
+/* maps the slot file of rom_hash, creating it if needed */
+bool slotfile_open(slotfile_t *sf, uint64_t rom_hash) {
+    char path[64];
+    memset(sf, 0, sizeof *sf);
+    sf->fd = -1;
+    sf->rom_hash = rom_hash;
+    slotfile_path(rom_hash, path, sizeof path);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        warnerr("Failed to open %s", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size != SLOTFILE_SIZE && ftruncate(fd, SLOTFILE_SIZE) != 0)) {
+        warnerr("Failed to size %s", path);
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, SLOTFILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        warnerr("Failed to map %s", path);
+        close(fd);
+        return false;
+    }
+    sf->map = map;
+    sf->fd = fd;
+
+    uint8_t *h = sf->map;
+    if (memcmp(h, slotfile_magic, 4) != 0 || get(h + 4, 2) > SLOTFILE_VERSION
+            || get(h + 6, 2) != SLOTFILE_SLOTS || get(h + 8, 4) != SLOTFILE_RECORD
+            || get(h + 12, 8) != rom_hash) {
+        /* new, or from an incompatible build, start it over */
+        if (memcmp(h, slotfile_magic, 4) == 0)
+            warn("Resetting incompatible slot file %s", path);
+        memset(sf->map, 0, SLOTFILE_SIZE);
+        memcpy(h, slotfile_magic, 4);
+        put(h + 4, SLOTFILE_VERSION, 2);
+        put(h + 6, SLOTFILE_SLOTS, 2);
+        put(h + 8, SLOTFILE_RECORD, 4);
+        put(h + 12, rom_hash, 8);
+    }
+    for (int slot = 0; slot < SLOTFILE_SLOTS; slot++) {
+        for (int which = 0; which < 2; which++) {
+            uint64_t seq = get(slotfile_record(sf, slot, which), 8);
+            if (seq > sf->seq)
+                sf->seq = seq;
+        }
+    }
+    return true;
+}
+
+/* schedules write back without waiting for it */
+void slotfile_sync(slotfile_t *sf) {
+    if (sf->map != NULL)
+        msync(sf->map, SLOTFILE_SIZE, MS_ASYNC);
+}
+
+void slotfile_close(slotfile_t *sf) {
+    if (sf->map == NULL)
+        return;
+    if (msync(sf->map, SLOTFILE_SIZE, MS_SYNC) != 0)
+        warnerr("Failed to flush save slots");
+    munmap(sf->map, SLOTFILE_SIZE);
+    close(sf->fd);
+    sf->map = NULL;
+    sf->fd = -1;
+}
+#endif
+
+/* encodes chip straight into the older record of slot, the newer one
+ * stays intact until the sequence number flips the order. no syscalls */
+bool slotfile_write(slotfile_t *sf, int slot, const chip8 *chip) {
+    if (sf->map == NULL || slot < 0 || slot >= SLOTFILE_SLOTS)
+        return false;
+    uint8_t *a = slotfile_record(sf, slot, 0), *b = slotfile_record(sf, slot, 1);
+    uint8_t *rec = get(a, 8) <= get(b, 8) ? a : b;
+    put(rec, 0, 8);
+    slotfile_barrier();
+    size_t len = chip8_state_encode(chip, rec + 16, SLOTFILE_RECORD - 16);
+    if (len == 0)
+        return false;
+    put(rec + 8, 0, 4);
+    put(rec + 12, len, 4);
+    slotfile_barrier();
+    put(rec, ++sf->seq, 8);
+    return true;
+}
+
+/* newest record of slot that decodes, false if there is none */
+bool slotfile_read(slotfile_t *sf, int slot, chip8 *chip) {
+    if (sf->map == NULL || slot < 0 || slot >= SLOTFILE_SLOTS)
+        return false;
+    uint8_t *rec[2] = { slotfile_record(sf, slot, 0), slotfile_record(sf, slot, 1) };
+    if (get(rec[0], 8) < get(rec[1], 8)) {
+        uint8_t *t = rec[0];
+        rec[0] = rec[1];
+        rec[1] = t;
+    }
+    for (int i = 0; i < 2; i++) {
+        size_t len = get(rec[i] + 12, 4);
+        if (get(rec[i], 8) == 0 || len > SLOTFILE_RECORD - 16)
+            continue;
+        if (chip8_state_decode(chip, rec[i] + 16, len))
+            return true;
+        warn("Save slot %d is damaged, trying its previous save", slot + 1);
+    }
+    return false;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef SLOTFILE_H_
+#define SLOTFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+#define SLOTFILE_SLOTS 10
+/* record header plus the largest encoded state, rounded up to 4k pages */
+#define SLOTFILE_RECORD ((16 + CHIP8_STATE_MAX + 4095) & ~(size_t)4095)
+#define SLOTFILE_HEADER 4096
+#define SLOTFILE_SIZE (SLOTFILE_HEADER + SLOTFILE_SLOTS * 2 * SLOTFILE_RECORD)
+
+typedef struct slotfile slotfile_t;
+
+/* every save slot of one rom in a single mapped file. each slot has two
+ * records written alternately, the one with the higher sequence number
+ * that still decodes is current, so a torn write only loses itself */
+struct slotfile {
+    uint8_t *map;
+    int fd;
+    uint64_t rom_hash;
+    uint64_t seq; /* highest sequence number in the file */
+};
+
+void slotfile_path(uint64_t rom_hash, char *buf, size_t size);
+bool slotfile_open(slotfile_t *sf, uint64_t rom_hash);
+bool slotfile_write(slotfile_t *sf, int slot, const chip8 *chip);
+bool slotfile_read(slotfile_t *sf, int slot, chip8 *chip);
+void slotfile_sync(slotfile_t *sf);
+void slotfile_close(slotfile_t *sf);
+
+#endif /* SLOTFILE_H_ */
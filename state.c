@@ -0,0 +1,284 @@
+#include "chip8.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * savestate format, every integer is little endian
+ *
+ *   "S8ST" u16 version, u16 reserved, u32 total length
+ *   chunks of tag[4] u32 length payload, unknown tags are skipped
+ *     REGS registers, timers, keys, clock and the live part of the stack
+ *     MEM  u32 memory size, run length coded memory
+ *     SCRN u8 width, u8 height, screen packed 8 pixels a byte msb first
+ *     SETT quirk flags, one bit each
+ *     RNG  u64 random generator state
+ *     FRAM u64 instructions retired, u64 frame end cycle, u8 inside a frame
+ *   u32 crc32 of everything before it
+ */
+
+#define STATE_VERSION 1
+#define STATE_HEADER 12
+
+static const uint8_t state_magic[4] = { 'S', '8', 'S', 'T' };
+
+enum {
+    sett_8xy6_8xye_do_vy = 1 << 0,
+    sett_fx55_fx65_increment = 1 << 1,
+    sett_8xy1_2_3_reset_vf = 1 << 2,
+    sett_screen_wrap_around = 1 << 3,
+};
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap, len;
+    bool ok;
+} writer;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len, pos;
+    bool ok;
+} reader;
+
+static uint32_t crc32(const uint8_t *buf, size_t len) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ buf[i]) & 0xF] ^ (crc >> 4);
+        crc = table[(crc ^ (buf[i] >> 4)) & 0xF] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+static void put(writer *w, uint64_t v, int bytes) {
+    if (w->len + bytes > w->cap) {
+        w->ok = false;
+        return;
+    }
+    for (int i = 0; i < bytes; i++)
+        w->buf[w->len++] = v >> (8 * i);
+}
+
+static void put_bytes(writer *w, const void *p, size_t n) {
+    if (w->len + n > w->cap) {
+        w->ok = false;
+        return;
+    }
+    memcpy(w->buf + w->len, p, n);
+    w->len += n;
+}
+
+/* returns the offset of the length field, patched by chunk_end */
+static size_t chunk_begin(writer *w, const char *tag) {
+    put_bytes(w, tag, 4);
+    put(w, 0, 4);
+    return w->len - 4;
+}
+
+static void chunk_end(writer *w, size_t at) {
+    if (!w->ok)
+        return;
+    uint32_t len = w->len - at - 4;
+    for (int i = 0; i < 4; i++)
+        w->buf[at + i] = len >> (8 * i);
+}
+
+static uint64_t get(reader *r, int bytes) {
+    uint64_t v = 0;
+    if (r->pos + bytes > r->len) {
+        r->ok = false;
+        return 0;
+    }
+    for (int i = 0; i < bytes; i++)
+        v |= (uint64_t)r->buf[r->pos++] << (8 * i);
+    return v;
+}
+
+size_t chip8_state_encode(const chip8 *chip, uint8_t *buf, size_t cap) {
+    writer w = { .buf = buf, .cap = cap, .ok = true };
+    size_t at;
+
+    put_bytes(&w, state_magic, 4);
+    put(&w, STATE_VERSION, 2);
+    put(&w, 0, 2);
+    put(&w, 0, 4);
+
+    at = chunk_begin(&w, "REGS");
+    put(&w, chip->pc, 2);
+    put(&w, chip->i, 2);
+    put(&w, chip->delaytimer, 1);
+    put(&w, chip->soundtimer, 1);
+    put(&w, chip->key_waiting, 1);
+    put(&w, chip->register_waiting, 1);
+    put(&w, chip->keys, 4);
+    put(&w, chip->clockspeed, 4);
+    put(&w, chip->cycle, 8);
+    put_bytes(&w, chip->v, NUM_REGISTERS);
+    put(&w, chip->sp, 1);
+    for (int i = 0; i < chip->sp; i++)
+        put(&w, chip->stack[i], 2);
+    chunk_end(&w, at);
+
+    at = chunk_begin(&w, "MEM ");
+    put(&w, MEMORY_SIZE, 4);
+    if (w.ok) {
+        size_t n = rle_encode(chip->memory, MEMORY_SIZE, w.buf + w.len, w.cap - w.len);
+        w.ok = n > 0;
+        w.len += n;
+    }
+    chunk_end(&w, at);
+
+    at = chunk_begin(&w, "SCRN");
+    put(&w, WIDTH, 1);
+    put(&w, HEIGHT, 1);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x += 8) {
+            uint8_t byte = 0;
+            for (int b = 0; b < 8; b++)
+                byte |= chip->screen[y][x + b] << (7 - b);
+            put(&w, byte, 1);
+        }
+    }
+    chunk_end(&w, at);
+
+    at = chunk_begin(&w, "SETT");
+    put(&w, (chip->settings.op_8xy6_8xye_do_vy ? sett_8xy6_8xye_do_vy : 0)
+            | (chip->settings.op_fx55_fx65_increment ? sett_fx55_fx65_increment : 0)
+            | (chip->settings.op_8xy1_2_3_reset_vf ? sett_8xy1_2_3_reset_vf : 0)
+            | (chip->settings.screen_wrap_around ? sett_screen_wrap_around : 0), 4);
+    chunk_end(&w, at);
+
+    at = chunk_begin(&w, "RNG ");
+    put(&w, chip->rng, 8);
+    chunk_end(&w, at);
+
+    at = chunk_begin(&w, "FRAM");
+    put(&w, chip->instret, 8);
+    put(&w, chip->frame_end, 8);
+    put(&w, chip->in_frame, 1);
+    chunk_end(&w, at);
+
+    if (!w.ok || w.len + 4 > w.cap)
+        return 0;
+    uint32_t total = w.len + 4;
+    for (int i = 0; i < 4; i++)
+        buf[8 + i] = total >> (8 * i);
+    put(&w, crc32(buf, w.len), 4);
+    return w.len;
+}
+
+static bool read_regs(chip8 *chip, reader *r) {
+    chip->pc = get(r, 2);
+    chip->i = get(r, 2);
+    chip->delaytimer = get(r, 1);
+    chip->soundtimer = get(r, 1);
+    chip->key_waiting = get(r, 1);
+    chip->register_waiting = get(r, 1);
+    chip->keys = get(r, 4);
+    chip->clockspeed = get(r, 4);
+    chip->cycle = get(r, 8);
+    for (int i = 0; i < NUM_REGISTERS; i++)
+        chip->v[i] = get(r, 1);
+    chip->sp = get(r, 1);
+    /* the core reads memory unchecked, so everything that addresses it
+     * must leave room for the reads that follow: a two byte fetch at pc or
+     * a return address, sixteen bytes of sprite or fx65 at i */
+    bool valid = chip->pc + 1 < MEMORY_SIZE && chip->i + 16 <= MEMORY_SIZE
+        && chip->clockspeed >= 0 && chip->clockspeed <= MAX_CLOCK;
+    for (int i = 0; i < chip->sp; i++) {
+        chip->stack[i] = get(r, 2);
+        valid = valid && chip->stack[i] + 1 < MEMORY_SIZE;
+    }
+    return r->ok && valid;
+}
+
+static bool read_screen(chip8 *chip, reader *r) {
+    if (get(r, 1) != WIDTH || get(r, 1) != HEIGHT)
+        return false;
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x += 8) {
+            uint8_t byte = get(r, 1);
+            for (int b = 0; b < 8; b++)
+                chip->screen[y][x + b] = byte >> (7 - b) & 1;
+        }
+    }
+    return r->ok;
+}
+
+static void read_settings(chip8 *chip, reader *r) {
+    uint32_t flags = get(r, 4);
+    chip->settings.op_8xy6_8xye_do_vy = flags & sett_8xy6_8xye_do_vy;
+    chip->settings.op_fx55_fx65_increment = flags & sett_fx55_fx65_increment;
+    chip->settings.op_8xy1_2_3_reset_vf = flags & sett_8xy1_2_3_reset_vf;
+    chip->settings.screen_wrap_around = flags & sett_screen_wrap_around;
+}
+
+/* chip is left untouched unless the whole state checks out */
+bool chip8_state_decode(chip8 *chip, const uint8_t *buf, size_t len) {
+    if (len < STATE_HEADER + 4 || memcmp(buf, state_magic, 4) != 0)
+        return false;
+    reader r = { .buf = buf, .len = len - 4, .pos = 4, .ok = true };
+    if (get(&r, 2) > STATE_VERSION)
+        return false;
+    get(&r, 2);
+    if (get(&r, 4) != len)
+        return false;
+    reader tail = { .buf = buf, .len = len, .pos = len - 4, .ok = true };
+    if (get(&tail, 4) != crc32(buf, len - 4))
+        return false;
+
+    chip8 *tmp = malloc(sizeof *tmp);
+    if (tmp == NULL)
+        return false;
+    chip8_init(tmp);
+    bool regs = false, mem = false, ok = true;
+    while (ok && r.pos < r.len) {
+        const uint8_t *tag = r.buf + r.pos;
+        r.pos += 4;
+        uint32_t n = get(&r, 4);
+        if (!r.ok || r.pos + n > r.len) {
+            ok = false;
+            break;
+        }
+        reader c = { .buf = r.buf + r.pos, .len = n, .ok = true };
+        r.pos += n;
+        if (memcmp(tag, "REGS", 4) == 0) {
+            ok = regs = read_regs(tmp, &c);
+        } else if (memcmp(tag, "MEM ", 4) == 0) {
+            ok = mem = get(&c, 4) == MEMORY_SIZE && rle_decode(c.buf + c.pos,
+                    c.len - c.pos, tmp->memory, MEMORY_SIZE) == MEMORY_SIZE;
+        } else if (memcmp(tag, "SCRN", 4) == 0) {
+            ok = read_screen(tmp, &c);
+        } else if (memcmp(tag, "SETT", 4) == 0) {
+            read_settings(tmp, &c);
+            ok = c.ok;
+        } else if (memcmp(tag, "RNG ", 4) == 0) {
+            uint64_t rng = get(&c, 8);
+            ok = c.ok && rng != 0;
+            tmp->rng = rng;
+        } else if (memcmp(tag, "FRAM", 4) == 0) {
+            tmp->instret = get(&c, 8);
+            tmp->frame_end = get(&c, 8);
+            tmp->in_frame = get(&c, 1);
+            ok = c.ok;
+        }
+    }
+    /* a frame in progress never has more than a frame of cycles left */
+    if (tmp->in_frame && (tmp->frame_end < tmp->cycle
+            || tmp->frame_end - tmp->cycle > (uint64_t)tmp->clockspeed / 60))
+        ok = false;
+    ok = ok && regs && mem;
+    if (ok) {
+        chip8_rehash(tmp);
+        memcpy(chip, tmp, sizeof *chip);
+    }
+    free(tmp);
+    return ok;
+}
+
@@ -0,0 +1,318 @@
+#define _POSIX_C_SOURCE 200809L
+#define SDL_DISABLE_IMMINTRIN_H
+#include "stateio.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#define stateio_fsync(fp) _commit(_fileno(fp))
+#define stateio_stat _stat64
+#define stateio_fstat _fstat64
+#else
+#include <unistd.h>
+#define stateio_fsync(fp) fsync(fileno(fp))
+#define stateio_stat stat
+#define stateio_fstat fstat
+#endif
+
+static char *stateio_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = malloc(len);
+    if (copy != NULL)
+        memcpy(copy, s, len);
+    return copy;
+}
+
+static void stateio_stamp_of(stateio_stamp *stamp, const struct stateio_stat *st) {
+    stamp->size = st->st_size;
+    stamp->mtime = st->st_mtime;
+#ifdef _WIN32
+    stamp->mtime_ns = 0;
+#else
+    stamp->mtime_ns = st->st_mtim.tv_nsec;
+#endif
+}
+
+/* the cache holds the bytes of the file, not a decoded chip, so a cached
+ * load goes through the same decode as one from disk */
+static void stateio_cache(stateio_t *io, const char *path, const uint8_t *buf, size_t len, const stateio_stamp *stamp) {
+    if (io->cache == NULL && (io->cache = malloc(CHIP8_STATE_MAX)) == NULL)
+        return;
+    free(io->cache_path);
+    if ((io->cache_path = stateio_strdup(path)) == NULL)
+        return;
+    memcpy(io->cache, buf, len);
+    io->cache_len = len;
+    io->cache_stamp = *stamp;
+}
+
+static bool stateio_cached(stateio_t *io, const char *path) {
+    struct stateio_stat st;
+    if (io->cache_path == NULL || strcmp(io->cache_path, path) != 0 || stateio_stat(path, &st) != 0)
+        return false;
+    stateio_stamp stamp;
+    stateio_stamp_of(&stamp, &st);
+    return stamp.size == io->cache_stamp.size && stamp.mtime == io->cache_stamp.mtime
+        && stamp.mtime_ns == io->cache_stamp.mtime_ns;
+}
+
+static FILE *stateio_write(stateio_t *io, stateio_job *job, uint8_t *buf) {
+    size_t len = chip8_state_encode(job->chip, buf, CHIP8_STATE_MAX);
+    free(io->cache_path);
+    io->cache_path = NULL;
+    io->pending_fp = NULL;
+    FILE *fp = fopen(job->path, "wb");
+    if (fp == NULL) {
+        warnerr("Failed to open %s for saving", job->path);
+        return NULL;
+    }
+    if (fwrite(buf, 1, len, fp) != len) {
+        warnerr("Failed writing %s", job->path);
+        fclose(fp);
+        return NULL;
+    }
+    /* kept aside until the sync, only a state known to be on disk is cached */
+    free(io->pending_path);
+    if ((io->pending_path = stateio_strdup(job->path)) != NULL && io->pending != NULL) {
+        memcpy(io->pending, buf, len);
+        io->pending_len = len;
+        io->pending_fp = fp;
+    }
+    job->ok = true;
+    return fp;
+}
+
+/* reads path into buf, a prefetch stops here with the bytes cached */
+static size_t stateio_fetch(stateio_t *io, const char *path, uint8_t *buf) {
+    if (stateio_cached(io, path)) {
+        memcpy(buf, io->cache, io->cache_len);
+        return io->cache_len;
+    }
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        warnerr("Failed to open %s for restoring", path);
+        return 0;
+    }
+    struct stateio_stat st;
+    bool stamped = stateio_fstat(fileno(fp), &st) == 0;
+    size_t len = fread(buf, 1, CHIP8_STATE_MAX, fp);
+    bool ok = !ferror(fp);
+    fclose(fp);
+    if (!ok) {
+        warnerr("Failed reading %s", path);
+        return 0;
+    }
+    if (stamped) {
+        stateio_stamp stamp;
+        stateio_stamp_of(&stamp, &st);
+        stateio_cache(io, path, buf, len, &stamp);
+    }
+    return len;
+}
+
+static void stateio_read(stateio_t *io, stateio_job *job, uint8_t *buf) {
+    size_t len = stateio_fetch(io, job->path, buf);
+    if (len == 0 || job->kind == stateio_kind_prefetch)
+        return;
+    if ((job->chip = malloc(sizeof *job->chip)) == NULL)
+        return;
+    if (!chip8_state_decode(job->chip, buf, len)) {
+        warn("Invalid save file %s", job->path);
+        return;
+    }
+    job->ok = true;
+}
+
+static void stateio_sync(stateio_t *io, FILE **files, int n) {
+    for (int i = 0; i < n; i++) {
+        bool ok = fflush(files[i]) == 0 && stateio_fsync(files[i]) == 0;
+        if (!ok)
+            warnerr("Failed to sync save file");
+        struct stateio_stat st;
+        if (ok && files[i] == io->pending_fp && stateio_fstat(fileno(files[i]), &st) == 0) {
+            stateio_stamp stamp;
+            stateio_stamp_of(&stamp, &st);
+            stateio_cache(io, io->pending_path, io->pending, io->pending_len, &stamp);
+        }
+        if (files[i] == io->pending_fp)
+            io->pending_fp = NULL;
+        fclose(files[i]);
+    }
+}
+
+static void stateio_finish(stateio_t *io, stateio_job *job) {
+    if (job->kind == stateio_kind_prefetch) {
+        free(job->chip);
+        free(job->path);
+        free(job);
+        return;
+    }
+    job->next = NULL;
+    SDL_LockMutex(io->lock);
+    if (io->done_tail != NULL)
+        io->done_tail->next = job;
+    else
+        io->done = job;
+    io->done_tail = job;
+    SDL_UnlockMutex(io->lock);
+}
+
+static int stateio_thread(void *userdata) {
+    stateio_t *io = userdata;
+    uint8_t *buf = malloc(CHIP8_STATE_MAX);
+    if (buf == NULL)
+        panic("Failed to allocate state buffer");
+    io->pending = malloc(CHIP8_STATE_MAX);
+    FILE *files[STATEIO_BATCH];
+    int nfiles = 0;
+
+    SDL_LockMutex(io->lock);
+    for (;;) {
+        while (io->todo == NULL && !io->quit)
+            SDL_CondWait(io->cond, io->lock);
+        stateio_job *batch = io->todo;
+        io->todo = io->todo_tail = NULL;
+        if (batch == NULL && io->quit)
+            break;
+        SDL_UnlockMutex(io->lock);
+
+        while (batch != NULL) {
+            stateio_job *job = batch;
+            batch = job->next;
+            if (job->kind == stateio_kind_save) {
+                FILE *fp = stateio_write(io, job, buf);
+                if (fp != NULL)
+                    files[nfiles++] = fp;
+                if (nfiles == STATEIO_BATCH) {
+                    stateio_sync(io, files, nfiles);
+                    nfiles = 0;
+                }
+            } else {
+                stateio_read(io, job, buf);
+            }
+            stateio_finish(io, job);
+        }
+        stateio_sync(io, files, nfiles);
+        nfiles = 0;
+
+        SDL_LockMutex(io->lock);
+    }
+    SDL_UnlockMutex(io->lock);
+    free(buf);
+    return 0;
+}
+
+static void stateio_push(stateio_t *io, enum stateio_kind kind, const char *path, const chip8 *chip) {
+    stateio_job *job = calloc(1, sizeof *job);
+    if (job == NULL || (job->path = stateio_strdup(path)) == NULL) {
+        warn("Failed to queue state I/O for %s", path);
+        free(job);
+        return;
+    }
+    job->kind = kind;
+    if (chip != NULL) {
+        if ((job->chip = malloc(sizeof *job->chip)) == NULL) {
+            warn("Failed to snapshot state for %s", path);
+            free(job->path);
+            free(job);
+            return;
+        }
+        memcpy(job->chip, chip, sizeof *chip);
+    }
+    SDL_LockMutex(io->lock);
+    if (io->todo_tail != NULL)
+        io->todo_tail->next = job;
+    else
+        io->todo = job;
+    io->todo_tail = job;
+    SDL_CondSignal(io->cond);
+    SDL_UnlockMutex(io->lock);
+}
+
+void stateio_init(stateio_t *io) {
+    memset(io, 0, sizeof *io);
+    io->lock = SDL_CreateMutex();
+    io->cond = SDL_CreateCond();
+    io->thread = SDL_CreateThread(stateio_thread, "stateio", io);
+    if (io->thread == NULL)
+        warn("Failed to create state I/O thread, saving blocks the frame");
+}
+
+void stateio_save(stateio_t *io, const char *path, const chip8 *chip) {
+    if (io->thread == NULL) {
+        chip8_save_to_file((chip8*)chip, path);
+        return;
+    }
+    stateio_push(io, stateio_kind_save, path, chip);
+}
+
+void stateio_load(stateio_t *io, const char *path) {
+    if (io->thread == NULL) {
+        stateio_job *job = calloc(1, sizeof *job);
+        if (job == NULL || (job->chip = malloc(sizeof *job->chip)) == NULL) {
+            free(job);
+            return;
+        }
+        job->kind = stateio_kind_load;
+        chip8_init(job->chip);
+        job->ok = chip8_restore_from_file(job->chip, path);
+        stateio_finish(io, job);
+        return;
+    }
+    stateio_push(io, stateio_kind_load, path, NULL);
+}
+
+/* read path ahead of a likely load, which then skips the disk as long as
+ * the file has not changed in between */
+void stateio_prefetch(stateio_t *io, const char *path) {
+    if (io->thread != NULL)
+        stateio_push(io, stateio_kind_prefetch, path, NULL);
+}
+
+bool stateio_poll(stateio_t *io, stateio_result *res) {
+    SDL_LockMutex(io->lock);
+    stateio_job *job = io->done;
+    if (job != NULL) {
+        io->done = job->next;
+        if (io->done == NULL)
+            io->done_tail = NULL;
+    }
+    SDL_UnlockMutex(io->lock);
+    if (job == NULL)
+        return false;
+    res->kind = job->kind;
+    res->ok = job->ok;
+    res->chip = NULL;
+    if (job->kind == stateio_kind_load && job->ok)
+        res->chip = job->chip;
+    else
+        free(job->chip);
+    free(job->path);
+    free(job);
+    return true;
+}
+
+/* pending saves are flushed to disk before this returns */
+void stateio_clean(stateio_t *io) {
+    if (io->thread != NULL) {
+        SDL_LockMutex(io->lock);
+        io->quit = true;
+        SDL_CondSignal(io->cond);
+        SDL_UnlockMutex(io->lock);
+        SDL_WaitThread(io->thread, NULL);
+    }
+    stateio_result res;
+    while (stateio_poll(io, &res))
+        free(res.chip);
+    free(io->cache);
+    free(io->cache_path);
+    free(io->pending);
+    free(io->pending_path);
+    SDL_DestroyCond(io->cond);
+    SDL_DestroyMutex(io->lock);
+}
+
@@ -0,0 +1,75 @@
+#pragma once
+#ifndef STATEIO_H_
+#define STATEIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "chip8.h"
+
+/* files written by one batch share a single round of fsync */
+#define STATEIO_BATCH 16
+
+enum stateio_kind {
+    stateio_kind_save,
+    stateio_kind_load,
+    stateio_kind_prefetch,
+};
+
+typedef struct {
+    enum stateio_kind kind;
+    bool ok;
+    chip8 *chip; /* restored state of a load, owned by the caller */
+} stateio_result;
+
+typedef struct stateio_job stateio_job;
+
+struct stateio_job {
+    stateio_job *next;
+    enum stateio_kind kind;
+    bool ok;
+    char *path;
+    chip8 *chip; /* snapshot to save, or the state a load produced */
+};
+
+/* what a cached file looked like on disk, a load whose file no longer
+ * matches goes back to the disk */
+typedef struct {
+    int64_t size;
+    int64_t mtime;
+    long mtime_ns;
+} stateio_stamp;
+
+typedef struct stateio stateio_t;
+
+/* save and restore state on a worker thread, the main thread only pays for
+ * a snapshot copy and picks up finished loads with stateio_poll */
+struct stateio {
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    bool quit;
+    stateio_job *todo, *todo_tail;
+    stateio_job *done, *done_tail;
+    /* worker only, bytes of the last state file read or synced */
+    char *cache_path;
+    uint8_t *cache;
+    size_t cache_len;
+    stateio_stamp cache_stamp;
+    /* worker only, last file written in a batch, cached once it syncs */
+    char *pending_path;
+    uint8_t *pending;
+    size_t pending_len;
+    FILE *pending_fp;
+};
+
+void stateio_init(stateio_t *io);
+void stateio_save(stateio_t *io, const char *path, const chip8 *chip);
+void stateio_load(stateio_t *io, const char *path);
+void stateio_prefetch(stateio_t *io, const char *path);
+bool stateio_poll(stateio_t *io, stateio_result *res);
+void stateio_clean(stateio_t *io);
+
+#endif /* STATEIO_H_ */
+
@@ -0,0 +1,235 @@
+#include "timeline.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool timeline_init(timeline_t *tl) {
+    memset(tl, 0, sizeof *tl);
+    tl->keyframes = malloc(TIMELINE_KEYFRAMES * sizeof *tl->keyframes);
+    tl->keyframe_log = malloc(TIMELINE_KEYFRAMES * sizeof *tl->keyframe_log);
+    tl->scratch = calloc(1, sizeof *tl->scratch);
+    if (tl->keyframes == NULL || tl->keyframe_log == NULL || tl->scratch == NULL) {
+        warn("Failed to allocate debugger history, reverse stepping is disabled");
+        timeline_clean(tl);
+        return false;
+    }
+    return true;
+}
+
+/* start logging the input pushed to chip */
+void timeline_attach(timeline_t *tl, chip8 *chip) {
+    timeline_reset(tl);
+    chip->input.trace = tl->keyframes != NULL ? tl : NULL;
+}
+
+/* forget everything, history starts over at the next keyframe */
+void timeline_reset(timeline_t *tl) {
+    tl->first = tl->count = 0;
+    tl->frames = 0;
+    tl->log_len = tl->log_base = 0;
+}
+
+void timeline_record_event(timeline_t *tl, uint64_t cycle, chip8_input_event ev) {
+    /* nothing to replay it from yet */
+    if (tl->count == 0)
+        return;
+    if (tl->log_len == tl->log_cap) {
+        size_t cap = tl->log_cap ? tl->log_cap * 2 : 256;
+        timeline_event *log = realloc(tl->log, cap * sizeof *log);
+        if (log == NULL) {
+            warn("Debugger history lost an input event, starting it over");
+            timeline_reset(tl);
+            return;
+        }
+        tl->log = log;
+        tl->log_cap = cap;
+    }
+    tl->log[tl->log_len++] = (timeline_event){ .ev = ev, .pushed_at = cycle };
+}
+
+static int timeline_index(timeline_t *tl, int k) {
+    return (tl->first + k) % TIMELINE_KEYFRAMES;
+}
+
+static void timeline_keyframe(timeline_t *tl, const chip8 *chip) {
+    if (tl->count == TIMELINE_KEYFRAMES) {
+        tl->first = timeline_index(tl, 1);
+        tl->count--;
+        /* events before the oldest keyframe are never replayed again,
+         * drop them once they make up half of the log */
+        size_t drop = tl->keyframe_log[tl->first] - tl->log_base;
+        if (drop > tl->log_len / 2) {
+            memmove(tl->log, tl->log + drop, (tl->log_len - drop) * sizeof *tl->log);
+            tl->log_len -= drop;
+            tl->log_base += drop;
+        }
+    }
+    int at = timeline_index(tl, tl->count);
+    memcpy(&tl->keyframes[at], chip, sizeof *chip);
+    tl->keyframe_log[at] = tl->log_base + tl->log_len;
+    tl->count++;
+    tl->frames = 0;
+}
+
+/* call after every frame the chip finished */
+void timeline_frame(timeline_t *tl, const chip8 *chip) {
+    if (tl->keyframes == NULL)
+        return;
+    if (tl->count == 0 || ++tl->frames >= TIMELINE_INTERVAL)
+        timeline_keyframe(tl, chip);
+}
+
+/* restore keyframe k into chip with the input hooks unplugged, returns
+ * the log position replay continues from */
+static size_t timeline_load(timeline_t *tl, chip8 *chip, int k) {
+    int at = timeline_index(tl, k);
+    chip8_restore(chip, &tl->keyframes[at]);
+    chip->input = tl->keyframes[at].input;
+    chip->input.record = NULL;
+    chip->input.trace = NULL;
+    return tl->keyframe_log[at];
+}
+
+/* push the logged events that had been pushed by chip's cycle when live */
+static void timeline_feed(timeline_t *tl, chip8 *chip, size_t *next) {
+    while (*next < tl->log_base + tl->log_len) {
+        const timeline_event *e = &tl->log[*next - tl->log_base];
+        if (e->pushed_at > chip->cycle)
+            break;
+        chip8_input_push(chip, e->ev);
+        (*next)++;
+    }
+}
+
+/* true when the instruction that just retired brought chip to cond */
+static bool timeline_hit(const timeline_cond *cond, const chip8 *chip, int *watched) {
+    bool hit = cond->breakpoint >= 0 && chip->pc == cond->breakpoint;
+    if (cond->watchpoint >= 0 && cond->watchpoint < MEMORY_SIZE) {
+        int now = chip->memory[cond->watchpoint];
+        if (now != *watched)
+            hit = true;
+        *watched = now;
+    }
+    return hit;
+}
+
+static int timeline_watched(const timeline_cond *cond, const chip8 *chip) {
+    if (cond->watchpoint < 0 || cond->watchpoint >= MEMORY_SIZE)
+        return 0;
+    return chip->memory[cond->watchpoint];
+}
+
+/* run until the next instruction retires, giving up at the end of the
+ * frame when the chip is waiting for a key or halted */
+bool timeline_step(timeline_t *tl, chip8 *chip) {
+    uint64_t instret = chip->instret;
+    if (tl->keyframes != NULL && tl->count == 0)
+        timeline_keyframe(tl, chip);
+    for (;;) {
+        bool frame = chip8_step(chip);
+        if (frame)
+            timeline_frame(tl, chip);
+        if (chip->instret != instret)
+            return true;
+        if (frame)
+            return false;
+    }
+}
+
+/* run the rest of the frame, returns true when it stopped early at cond */
+bool timeline_run_frame(timeline_t *tl, chip8 *chip, const timeline_cond *cond) {
+    int watched = timeline_watched(cond, chip);
+    if (tl->keyframes != NULL && tl->count == 0)
+        timeline_keyframe(tl, chip);
+    for (;;) {
+        uint64_t instret = chip->instret;
+        bool frame = chip8_step(chip);
+        if (frame)
+            timeline_frame(tl, chip);
+        if (chip->instret != instret && timeline_hit(cond, chip, &watched))
+            return true;
+        if (frame)
+            return false;
+    }
+}
+
+/* move chip back to right after its instret-th instruction retired.
+ * history past that point is dropped, running on from there branches */
+bool timeline_seek(timeline_t *tl, chip8 *chip, uint64_t instret) {
+    if (tl->count == 0 || instret > chip->instret)
+        return false;
+    int k = tl->count - 1;
+    while (k >= 0 && tl->keyframes[timeline_index(tl, k)].instret >= instret)
+        k--;
+    if (k < 0) {
+        if (tl->keyframes[tl->first].instret != instret)
+            return false;
+        k = 0;
+    }
+
+    uint64_t limit = chip->cycle;
+    chip8_input_queue live = chip->input;
+    size_t next = timeline_load(tl, chip, k);
+    int frames = 0;
+    while (chip->instret < instret && chip->cycle < limit) {
+        timeline_feed(tl, chip, &next);
+        if (chip8_step(chip))
+            frames++;
+    }
+    timeline_feed(tl, chip, &next);
+    chip->input.record = live.record;
+    chip->input.trace = live.trace;
+
+    tl->count = k + 1;
+    tl->frames = frames;
+    tl->log_len = next - tl->log_base;
+    return chip->instret == instret;
+}
+
+bool timeline_step_back(timeline_t *tl, chip8 *chip) {
+    if (chip->instret == 0)
+        return false;
+    return timeline_seek(tl, chip, chip->instret - 1);
+}
+
+/* go back to the latest point before now where cond held, or to the start
+ * of history when it never did. each keyframe interval is searched on the
+ * scratch chip, newest first, and only the hit is replayed on chip */
+bool timeline_reverse_continue(timeline_t *tl, chip8 *chip, const timeline_cond *cond) {
+    if (tl->count == 0)
+        return false;
+    uint64_t limit = chip->instret;
+    for (int k = tl->count - 1; k >= 0; k--) {
+        chip8 *scan = tl->scratch;
+        if (tl->keyframes[timeline_index(tl, k)].instret >= limit)
+            continue;
+        size_t next = timeline_load(tl, scan, k);
+        int watched = timeline_watched(cond, scan);
+        uint64_t found = 0;
+        bool hit = false;
+        while (scan->instret < limit && scan->cycle < chip->cycle) {
+            uint64_t instret = scan->instret;
+            timeline_feed(tl, scan, &next);
+            chip8_step(scan);
+            if (scan->instret != instret && scan->instret < limit
+                    && timeline_hit(cond, scan, &watched)) {
+                hit = true;
+                found = scan->instret;
+            }
+        }
+        if (hit)
+            return timeline_seek(tl, chip, found);
+        limit = tl->keyframes[timeline_index(tl, k)].instret;
+    }
+    timeline_seek(tl, chip, tl->keyframes[tl->first].instret);
+    return false;
+}
+
+void timeline_clean(timeline_t *tl) {
+    free(tl->keyframes);
+    free(tl->keyframe_log);
+    free(tl->log);
+    free(tl->scratch);
+    memset(tl, 0, sizeof *tl);
+}
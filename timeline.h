@@ -0,0 +1,55 @@
+#pragma once
+#ifndef TIMELINE_H_
+#define TIMELINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "chip8.h"
+
+#define TIMELINE_KEYFRAMES 256 /* a bit over four minutes of history */
+#define TIMELINE_INTERVAL 60 /* frames between keyframes */
+
+typedef struct {
+    chip8_input_event ev;
+    uint64_t pushed_at; /* chip cycle when it went into the queue */
+} timeline_event;
+
+/* where continuing, forwards or backwards, stops */
+typedef struct {
+    int breakpoint; /* pc, -1 for none */
+    int watchpoint; /* memory address whose byte changing stops, -1 for none */
+} timeline_cond;
+
+typedef struct timeline timeline_t;
+
+/* debugger history. the chip is deterministic given its input, so going
+ * back to any instruction is restoring the keyframe before it and running
+ * forward again while feeding the logged events back in */
+struct timeline {
+    chip8 *keyframes; /* ring of TIMELINE_KEYFRAMES */
+    size_t *keyframe_log; /* log position each keyframe was taken at */
+    int first, count;
+    int frames; /* frames run since the newest keyframe */
+
+    /* every event pushed since the oldest keyframe, log_base counts the
+     * ones already dropped off the front */
+    timeline_event *log;
+    size_t log_len, log_cap, log_base;
+
+    chip8 *scratch; /* searched on by reverse continue */
+};
+
+bool timeline_init(timeline_t *tl);
+void timeline_attach(timeline_t *tl, chip8 *chip);
+void timeline_reset(timeline_t *tl);
+void timeline_record_event(timeline_t *tl, uint64_t cycle, chip8_input_event ev);
+void timeline_frame(timeline_t *tl, const chip8 *chip);
+bool timeline_step(timeline_t *tl, chip8 *chip);
+bool timeline_run_frame(timeline_t *tl, chip8 *chip, const timeline_cond *cond);
+bool timeline_seek(timeline_t *tl, chip8 *chip, uint64_t instret);
+bool timeline_step_back(timeline_t *tl, chip8 *chip);
+bool timeline_reverse_continue(timeline_t *tl, chip8 *chip, const timeline_cond *cond);
+void timeline_clean(timeline_t *tl);
+
+#endif /* TIMELINE_H_ */